@@ -0,0 +1,206 @@
+/*
+ *  heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <tet_api.h>
+#include <heynoti.h>
+
+static void startup(void);
+static void cleanup(void);
+
+void (*tet_startup)(void) = startup;
+void (*tet_cleanup)(void) = cleanup;
+
+static void utc_ApplicationFW_heynoti_backend_broker_func_01(void);
+static void utc_ApplicationFW_heynoti_backend_broker_func_02(void);
+static void utc_ApplicationFW_heynoti_backend_broker_func_03(void);
+
+enum {
+	POSITIVE_TC_IDX = 0x01,
+	NEGATIVE_TC_IDX,
+};
+
+struct tet_testlist tet_testlist[] = {
+	{ utc_ApplicationFW_heynoti_backend_broker_func_01, POSITIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_backend_broker_func_02, POSITIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_backend_broker_func_03, NEGATIVE_TC_IDX },
+	{ NULL, 0},
+};
+
+char made[2][FILENAME_MAX];	/* noti files made by startup */
+int n_cb;
+int n_match;
+int n_other;
+
+void callback(void *data)
+{
+	n_cb++;
+}
+
+void pattern_callback(const char *noti, void *data)
+{
+	if (!strcmp(noti, "test_testnoti"))
+		n_match++;
+	else
+		n_other++;
+}
+
+/* a noti file must exist to be published */
+static void make_noti(int i, const char *noti)
+{
+	char path[FILENAME_MAX];
+	int fd;
+
+	heynoti_get_noti_path(noti, path, sizeof(path));
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd == -1)
+		return;
+	close(fd);
+	snprintf(made[i], sizeof(made[i]), "%s", path);
+}
+
+static void dispatch(int fd)
+{
+	struct pollfd p = { fd, POLLIN, 0 };
+
+	while (poll(&p, 1, 100) == 1)
+		heynoti_poll_event(fd);
+}
+
+/* a context of the broker backend, -1 with the result set if there is none */
+static int init_backend(void)
+{
+	int fd;
+
+	if (heynoti_set_backend("broker")) {
+		tet_infoline("heynotid is not running");
+		tet_result(TET_UNSUPPORTED);
+		return -1;
+	}
+
+	fd = heynoti_init();
+	if (fd < 0) {
+		tet_infoline("heynoti_init() failed with the broker backend");
+		tet_result(TET_FAIL);
+	}
+
+	return fd;
+}
+
+static void startup(void)
+{
+	make_noti(0, "test_testnoti");
+	make_noti(1, "other_testnoti");
+}
+
+static void cleanup(void)
+{
+	int i;
+
+	heynoti_set_backend("inotify");
+
+	for (i = 0; i < 2; i++) {
+		if (made[i][0])
+			unlink(made[i]);
+	}
+}
+
+/**
+ * @brief Positive test case of heynoti_subscribe() with the broker backend
+ */
+static void utc_ApplicationFW_heynoti_backend_broker_func_01(void)
+{
+	int fd;
+	int r = 0;
+
+	fd = init_backend();
+	if (fd < 0)
+		return;
+
+	r = heynoti_subscribe(fd, "test_testnoti", callback, NULL);
+	if (!r) {
+		heynoti_publish("test_testnoti");
+		dispatch(fd);
+	}
+	heynoti_close(fd);
+
+	if (r || n_cb != 1) {
+		tet_infoline("heynoti_subscribe() failed in broker test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Positive test case of heynoti_subscribe_pattern() with the broker backend
+ */
+static void utc_ApplicationFW_heynoti_backend_broker_func_02(void)
+{
+	int fd;
+	int r = 0;
+
+	fd = init_backend();
+	if (fd < 0)
+		return;
+
+	r = heynoti_subscribe_pattern(fd, "test_*", pattern_callback, NULL);
+	if (!r) {
+		heynoti_publish("test_testnoti");
+		heynoti_publish("other_testnoti");
+		dispatch(fd);
+	}
+	heynoti_close(fd);
+
+	if (r || n_match != 1 || n_other != 0) {
+		tet_infoline("heynoti_subscribe_pattern() failed in broker test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Negative test case of heynoti_publish() with the broker backend
+ */
+static void utc_ApplicationFW_heynoti_backend_broker_func_03(void)
+{
+	int r = 0;
+
+	if (heynoti_set_backend("broker")) {
+		tet_infoline("heynotid is not running");
+		tet_result(TET_UNSUPPORTED);
+		return;
+	}
+
+	r = heynoti_publish("test_nonexistent_testnoti");
+
+	if (r != -1 || errno != ENOENT) {
+		tet_infoline("heynoti_publish() failed in broker negative test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
@@ -0,0 +1,148 @@
+/*
+ *  heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <tet_api.h>
+#include <heynoti.h>
+
+static void startup(void);
+static void cleanup(void);
+
+void (*tet_startup)(void) = startup;
+void (*tet_cleanup)(void) = cleanup;
+
+static void utc_ApplicationFW_heynoti_publish_data_func_01(void);
+static void utc_ApplicationFW_heynoti_publish_data_func_02(void);
+
+enum {
+	POSITIVE_TC_IDX = 0x01,
+	NEGATIVE_TC_IDX,
+};
+
+struct tet_testlist tet_testlist[] = {
+	{ utc_ApplicationFW_heynoti_publish_data_func_01, POSITIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_publish_data_func_02, NEGATIVE_TC_IDX },
+	{ NULL, 0},
+};
+
+int fd;
+char noti_path[FILENAME_MAX];
+int made;	/* startup made the noti file */
+char got[16];
+int got_len;
+
+void callback(const void *buf, int len, void *data)
+{
+	got_len = len;
+	if (len > 0 && len < sizeof(got))
+		memcpy(got, buf, len);
+}
+
+static void startup(void)
+{
+	char *err;
+	int r;
+
+	fd  = heynoti_init();
+
+	if (fd < 0) {
+		err = "Error init heynoti";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+	}
+
+	/* a noti file must exist before it can be subscribed */
+	heynoti_get_noti_path("test_testnoti", noti_path, sizeof(noti_path));
+	r = open(noti_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (r != -1) {
+		close(r);
+		made = 1;
+	}
+
+	r = heynoti_subscribe_data(fd, "test_testnoti", callback, NULL);
+	if (r) {
+		err = "Error subscribe";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+	}
+}
+
+static void cleanup(void)
+{
+	heynoti_unsubscribe(fd, "test_testnoti", (void (*)(void *))callback);
+	heynoti_close(fd);
+
+	/* the payload is kept by the key, drop it with the key */
+	if (made) {
+		heynoti_unregister_key("test_testnoti");
+		unlink(noti_path);
+	}
+}
+
+/**
+ * @brief Positive test case of heynoti_publish_data()
+ */
+static void utc_ApplicationFW_heynoti_publish_data_func_01(void)
+{
+	struct pollfd p = { fd, POLLIN, 0 };
+	int r = 0;
+
+	r = heynoti_publish_data("test_testnoti", "data", 4);
+
+	if (r) {
+		tet_infoline("heynoti_publish_data() failed in positive test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	/* the payload does not live in the noti file */
+	close(open(noti_path, O_WRONLY | O_TRUNC));
+
+	while (poll(&p, 1, 100) == 1)
+		heynoti_poll_event(fd);
+
+	if (got_len != 4 || memcmp(got, "data", 4)) {
+		tet_infoline("heynoti_publish_data() payload did not arrive");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Negative test case of ug_init heynoti_publish_data()
+ */
+static void utc_ApplicationFW_heynoti_publish_data_func_02(void)
+{
+	int r = 0;
+
+	r = heynoti_publish_data(NULL, "data", 4);
+
+	if (!r) {
+		tet_infoline("heynoti_publish_data() failed in negative test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
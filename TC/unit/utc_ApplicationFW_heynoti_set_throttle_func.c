@@ -0,0 +1,172 @@
+/*
+ *  heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+#include <tet_api.h>
+#include <heynoti.h>
+
+#define WINDOW	100	/* msec */
+#define BURST	20	/* publishes, one every 10 msec */
+
+static void startup(void);
+static void cleanup(void);
+
+void (*tet_startup)(void) = startup;
+void (*tet_cleanup)(void) = cleanup;
+
+static void utc_ApplicationFW_heynoti_set_throttle_func_01(void);
+static void utc_ApplicationFW_heynoti_set_throttle_func_02(void);
+
+enum {
+	POSITIVE_TC_IDX = 0x01,
+	NEGATIVE_TC_IDX,
+};
+
+struct tet_testlist tet_testlist[] = {
+	{ utc_ApplicationFW_heynoti_set_throttle_func_01, POSITIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_set_throttle_func_02, NEGATIVE_TC_IDX },
+	{ NULL, 0},
+};
+
+int fd;
+char made[FILENAME_MAX];	/* the noti file made by startup */
+int n_pub;
+int n_cb;
+
+void callback(void *data)
+{
+	n_cb++;
+}
+
+static gboolean publish(gpointer data)
+{
+	heynoti_publish("test_testnoti");
+
+	return ++n_pub < BURST;
+}
+
+static gboolean quit(gpointer data)
+{
+	g_main_loop_quit(data);
+
+	return FALSE;
+}
+
+static void startup(void)
+{
+	char path[FILENAME_MAX];
+	char *err;
+	int r;
+
+	fd  = heynoti_init();
+
+	if (fd < 0) {
+		err = "Error init heynoti";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+		tet_delete(NEGATIVE_TC_IDX, err);
+	}
+
+	/* a noti file must exist before it can be subscribed */
+	heynoti_get_noti_path("test_testnoti", path, sizeof(path));
+	r = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (r != -1) {
+		close(r);
+		snprintf(made, sizeof(made), "%s", path);
+	}
+
+	r = heynoti_subscribe(fd, "test_testnoti", callback, NULL);
+	if (r) {
+		err = "Error subscribe";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+		tet_delete(NEGATIVE_TC_IDX, err);
+	}
+}
+
+static void cleanup(void)
+{
+	heynoti_unsubscribe(fd, "test_testnoti", callback);
+	heynoti_close(fd);
+
+	if (made[0])
+		unlink(made);
+}
+
+/**
+ * @brief Positive test case of heynoti_set_throttle()
+ */
+static void utc_ApplicationFW_heynoti_set_throttle_func_01(void)
+{
+	GMainLoop *loop;
+	int r = 0;
+
+	r = heynoti_set_throttle(fd, "test_testnoti", callback, WINDOW);
+
+	if (r) {
+		tet_infoline("heynoti_set_throttle() failed in positive test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	r = heynoti_attach_handler(fd);
+	if (r) {
+		tet_infoline("heynoti_attach_handler() failed in positive test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	/* a 200 msec burst, then twice the window for the held events */
+	loop = g_main_loop_new(NULL, FALSE);
+	g_timeout_add(10, publish, NULL);
+	g_timeout_add(BURST * 10 + 2 * WINDOW, quit, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+
+	heynoti_detach_handler(fd);
+
+	/* the first event at once, then about one per window */
+	if (n_cb < 2 || n_cb > BURST * 10 / WINDOW + 2) {
+		tet_infoline("heynoti_set_throttle() delivered a wrong count");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Negative test case of ug_init heynoti_set_throttle()
+ */
+static void utc_ApplicationFW_heynoti_set_throttle_func_02(void)
+{
+	int r = 0;
+
+	r = heynoti_set_throttle(fd, "test_testnoti", callback, -1);
+
+	if (!r) {
+		tet_infoline("heynoti_set_throttle() failed in negative test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
@@ -0,0 +1,169 @@
+/*
+ *  heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <tet_api.h>
+#include <heynoti.h>
+
+static void startup(void);
+static void cleanup(void);
+
+void (*tet_startup)(void) = startup;
+void (*tet_cleanup)(void) = cleanup;
+
+static void utc_ApplicationFW_heynoti_subscribe_coalesce_func_01(void);
+static void utc_ApplicationFW_heynoti_subscribe_coalesce_func_02(void);
+
+enum {
+	POSITIVE_TC_IDX = 0x01,
+	NEGATIVE_TC_IDX,
+};
+
+struct tet_testlist tet_testlist[] = {
+	{ utc_ApplicationFW_heynoti_subscribe_coalesce_func_01, POSITIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_subscribe_coalesce_func_02, NEGATIVE_TC_IDX },
+	{ NULL, 0},
+};
+
+int fd;
+char made[2][FILENAME_MAX];	/* noti files made by startup */
+int n_cb;
+int n_ev;
+
+void callback(void *data, int count)
+{
+	n_cb++;
+	n_ev = count;
+}
+
+void other(void *data)
+{
+
+}
+
+static void make_noti(int i, const char *noti)
+{
+	char path[FILENAME_MAX];
+	int fd;
+
+	heynoti_get_noti_path(noti, path, sizeof(path));
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd == -1)
+		return;
+	close(fd);
+	snprintf(made[i], sizeof(made[i]), "%s", path);
+}
+
+static void startup(void)
+{
+	char *err;
+	int r;
+
+	fd  = heynoti_init();
+
+	if (fd < 0) {
+		err = "Error init heynoti";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+		tet_delete(NEGATIVE_TC_IDX, err);
+	}
+
+	make_noti(0, "test_testnoti");
+	make_noti(1, "test_testnoti2");
+
+	/* the kernel folds back-to-back events of one file, so interleave */
+	r = heynoti_subscribe(fd, "test_testnoti2", other, NULL);
+	if (r) {
+		err = "Error subscribe";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+	}
+}
+
+static void cleanup(void)
+{
+	int i;
+
+	heynoti_unsubscribe(fd, "test_testnoti", (void (*)(void *))callback);
+	heynoti_unsubscribe(fd, "test_testnoti2", other);
+	heynoti_close(fd);
+
+	for (i = 0; i < 2; i++) {
+		if (made[i][0])
+			unlink(made[i]);
+	}
+}
+
+/**
+ * @brief Positive test case of heynoti_subscribe_coalesce()
+ */
+static void utc_ApplicationFW_heynoti_subscribe_coalesce_func_01(void)
+{
+	struct pollfd p = { fd, POLLIN, 0 };
+	int r = 0;
+
+	r = heynoti_subscribe_coalesce(fd, "test_testnoti", callback, NULL);
+
+	if (r) {
+		tet_infoline("heynoti_subscribe_coalesce() failed in positive test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	heynoti_publish("test_testnoti");
+	heynoti_publish("test_testnoti2");
+	heynoti_publish("test_testnoti");
+	heynoti_publish("test_testnoti2");
+	heynoti_publish("test_testnoti");
+
+	if (poll(&p, 1, 1000) != 1 || heynoti_poll_event(fd) < 0) {
+		tet_infoline("heynoti_poll_event() failed in positive test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	/* three events of one read fold into a single call */
+	if (n_cb != 1 || n_ev != 3) {
+		tet_infoline("heynoti_subscribe_coalesce() did not fold the events");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Negative test case of ug_init heynoti_subscribe_coalesce()
+ */
+static void utc_ApplicationFW_heynoti_subscribe_coalesce_func_02(void)
+{
+	int r = 0;
+
+	r = heynoti_subscribe_coalesce(fd, NULL, callback, NULL);
+
+	if (!r) {
+		tet_infoline("heynoti_subscribe_coalesce() failed in negative test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
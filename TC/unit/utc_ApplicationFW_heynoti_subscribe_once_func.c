@@ -0,0 +1,172 @@
+/*
+ *  heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <tet_api.h>
+#include <heynoti.h>
+
+static void startup(void);
+static void cleanup(void);
+
+void (*tet_startup)(void) = startup;
+void (*tet_cleanup)(void) = cleanup;
+
+static void utc_ApplicationFW_heynoti_subscribe_once_func_01(void);
+static void utc_ApplicationFW_heynoti_subscribe_once_func_02(void);
+static void utc_ApplicationFW_heynoti_subscribe_once_func_03(void);
+
+enum {
+	POSITIVE_TC_IDX = 0x01,
+	NEGATIVE_TC_IDX,
+};
+
+struct tet_testlist tet_testlist[] = {
+	{ utc_ApplicationFW_heynoti_subscribe_once_func_01, POSITIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_subscribe_once_func_02, NEGATIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_subscribe_once_func_03, NEGATIVE_TC_IDX },
+	{ NULL, 0},
+};
+
+int fd;
+char made[FILENAME_MAX];	/* the noti file made by startup */
+int n_cb;
+
+void callback(void *data)
+{
+	n_cb++;
+}
+
+static void dispatch(void)
+{
+	struct pollfd p = { fd, POLLIN, 0 };
+
+	while (poll(&p, 1, 100) == 1)
+		heynoti_poll_event(fd);
+}
+
+static void startup(void)
+{
+	char path[FILENAME_MAX];
+	char *err;
+	int r;
+
+	fd  = heynoti_init();
+
+	if (fd < 0) {
+		err = "Error init heynoti";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+		tet_delete(NEGATIVE_TC_IDX, err);
+	}
+
+	/* a noti file must exist before it can be subscribed */
+	heynoti_get_noti_path("test_testnoti", path, sizeof(path));
+	r = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (r != -1) {
+		close(r);
+		snprintf(made, sizeof(made), "%s", path);
+	}
+}
+
+static void cleanup(void)
+{
+	heynoti_unsubscribe(fd, "test_testnoti", callback);
+	heynoti_close(fd);
+
+	if (made[0])
+		unlink(made);
+}
+
+/**
+ * @brief Positive test case of heynoti_subscribe_once()
+ */
+static void utc_ApplicationFW_heynoti_subscribe_once_func_01(void)
+{
+	int r = 0;
+
+	r = heynoti_subscribe_once(fd, "test_testnoti", callback, NULL);
+
+	if (r) {
+		tet_infoline("heynoti_subscribe_once() failed in positive test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	heynoti_publish("test_testnoti");
+	dispatch();
+	heynoti_publish("test_testnoti");
+	dispatch();
+
+	/* the subscription is gone after the first delivery */
+	if (n_cb != 1) {
+		tet_infoline("heynoti_subscribe_once() did not fire exactly once");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Negative test case of ug_init heynoti_subscribe_once()
+ */
+static void utc_ApplicationFW_heynoti_subscribe_once_func_02(void)
+{
+	int r = 0;
+
+	r = heynoti_subscribe_once(fd, "test_testnoti", NULL, NULL);
+
+	if (r != -1) {
+		tet_infoline("heynoti_subscribe_once() failed in negative test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Negative test case of a window on heynoti_subscribe_once()
+ */
+static void utc_ApplicationFW_heynoti_subscribe_once_func_03(void)
+{
+	int err;
+	int r = 0;
+
+	r = heynoti_subscribe_once(fd, "test_testnoti", callback, NULL);
+	if (r) {
+		tet_infoline("heynoti_subscribe_once() failed in negative test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	r = heynoti_set_throttle(fd, "test_testnoti", callback, 100);
+	err = errno;
+	heynoti_unsubscribe(fd, "test_testnoti", callback);
+
+	if (r != -1 || err != ENOTSUP) {
+		tet_infoline("heynoti_set_throttle() took a one-shot subscription");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
@@ -0,0 +1,160 @@
+/*
+ *  heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <tet_api.h>
+#include <heynoti.h>
+
+static void startup(void);
+static void cleanup(void);
+
+void (*tet_startup)(void) = startup;
+void (*tet_cleanup)(void) = cleanup;
+
+static void utc_ApplicationFW_heynoti_subscribe_pattern_func_01(void);
+static void utc_ApplicationFW_heynoti_subscribe_pattern_func_02(void);
+
+enum {
+	POSITIVE_TC_IDX = 0x01,
+	NEGATIVE_TC_IDX,
+};
+
+struct tet_testlist tet_testlist[] = {
+	{ utc_ApplicationFW_heynoti_subscribe_pattern_func_01, POSITIVE_TC_IDX },
+	{ utc_ApplicationFW_heynoti_subscribe_pattern_func_02, NEGATIVE_TC_IDX },
+	{ NULL, 0},
+};
+
+int fd;
+char made[2][FILENAME_MAX];	/* noti files made by startup */
+int n_match;
+int n_other;
+
+void callback(const char *noti, void *data)
+{
+	if (!strcmp(noti, "test_testnoti"))
+		n_match++;
+	else
+		n_other++;
+}
+
+static void make_noti(int i, const char *noti)
+{
+	char path[FILENAME_MAX];
+	int fd;
+
+	heynoti_get_noti_path(noti, path, sizeof(path));
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd == -1)
+		return;
+	close(fd);
+	snprintf(made[i], sizeof(made[i]), "%s", path);
+}
+
+/* publish a matching and a non-matching key, and count the calls */
+static int check_pattern(int pfd)
+{
+	struct pollfd p = { pfd, POLLIN, 0 };
+
+	n_match = 0;
+	n_other = 0;
+
+	heynoti_publish("test_testnoti");
+	heynoti_publish("other_testnoti");
+
+	while (poll(&p, 1, 100) == 1)
+		heynoti_poll_event(pfd);
+
+	return n_match == 1 && n_other == 0 ? 0 : -1;
+}
+
+static void startup(void)
+{
+	char *err;
+
+	fd  = heynoti_init();
+
+	if (fd < 0) {
+		err = "Error init heynoti";
+		tet_infoline(err);
+		tet_delete(POSITIVE_TC_IDX, err);
+		tet_delete(NEGATIVE_TC_IDX, err);
+	}
+
+	make_noti(0, "test_testnoti");
+	make_noti(1, "other_testnoti");
+}
+
+static void cleanup(void)
+{
+	int i;
+
+	heynoti_unsubscribe_pattern(fd, "test_*", callback);
+	heynoti_close(fd);
+
+	for (i = 0; i < 2; i++) {
+		if (made[i][0])
+			unlink(made[i]);
+	}
+}
+
+/**
+ * @brief Positive test case of heynoti_subscribe_pattern()
+ */
+static void utc_ApplicationFW_heynoti_subscribe_pattern_func_01(void)
+{
+	int r = 0;
+
+	r = heynoti_subscribe_pattern(fd, "test_*", callback, NULL);
+
+	if (r) {
+		tet_infoline("heynoti_subscribe_pattern() failed in positive test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+
+	if (check_pattern(fd)) {
+		tet_infoline("heynoti_subscribe_pattern() matched the wrong notis");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
+
+/**
+ * @brief Negative test case of ug_init heynoti_subscribe_pattern()
+ */
+static void utc_ApplicationFW_heynoti_subscribe_pattern_func_02(void)
+{
+	int r = 0;
+
+	r = heynoti_subscribe_pattern(fd, "test/*", callback, NULL);
+
+	if (r != -1) {
+		tet_infoline("heynoti_subscribe_pattern() failed in negative test case");
+		tet_result(TET_FAIL);
+		return;
+	}
+	tet_result(TET_PASS);
+}
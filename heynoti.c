@@ -34,10 +34,30 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <poll.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
 #include <glib.h>
 #include <sys/utsname.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#ifdef HAVE_IO_URING
+#include <pthread.h>
+#include <linux/io_uring.h>
+#endif
 
+#include "heynoti.h"
 #include "heynoti-internal.h"
+#include "heynoti-broker.h"
 
 #define AU_PREFIX_SYSNOTI "SYS"
 
@@ -45,34 +65,474 @@
 #  define NOTI_ROOT "/opt/share/noti"
 #endif
 
+#ifndef HEYNOTI_BACKEND
+#  define HEYNOTI_BACKEND "inotify"
+#endif
+
+/*
+ * Sharded layout: a noti lives in NOTI_ROOT/<xx>/<name>, xx being the
+ * hex shard of its name. Turned on by the marker file, see
+ * heynoti_migrate_sharded().
+ */
+#define NOTI_SHARDS	256
+#define NOTI_META	".heynoti_"	/* files of noti_root that are no notis */
+#define NOTI_SHARD_MARKER NOTI_META "sharded"
+
+/* events of noti_root and its shards, routed by name */
+#define ROOT_MASK	(IN_CLOSE_WRITE | IN_DELETE)
+
 
 #define NODAC_PERMISSION
 
+/* one event header plus the longest possible name */
+#define EVENT_BUF_MIN (sizeof(struct inotify_event) + NAME_MAX + 1)
+#define EVENT_BUF_DEFAULT (EVENT_BUF_MIN * 16)
+#define EVENT_BUF_MAX (1024 * 1024)
+
+/* slot flags */
+#define NS_COALESCE	0x01	/* cb is void (*)(void *, int) */
+#define NS_BATCH	0x02	/* cb is heynoti_batch_cb */
+#define NS_THROTTLE	0x04	/* at most once per window */
+#define NS_DEBOUNCE	0x08	/* once after a quiet window */
+#define NS_WINDOW	(NS_THROTTLE | NS_DEBOUNCE)
+#define NS_POOL		0x10	/* called from the worker pool */
+#define NS_ID		0x20	/* subscribed by id, cb need not be unique */
+#define NS_ONCE		0x40	/* removed after the first delivery */
+#define NS_PATTERN	0x80	/* noti is a glob, cb is heynoti_pattern_cb */
+#define NS_DATA		0x100	/* cb is heynoti_data_cb, gets the payload */
+
+#ifndef IN_MASK_CREATE
+#define IN_MASK_CREATE	0x10000000	/* linux 4.18, ignored before */
+#endif
+
+#define POOL_THREADS_DEFAULT 4
+#define POOL_QUEUE_MAX	1024	/* jobs waiting on one key */
+
+/*
+ * Callbacks of one key run in order: a key has one queue of jobs and
+ * at most one worker draining it at a time.
+ */
+struct noti_queue {
+	GMutex lock;
+	GQueue jobs;
+	int running;
+	int dropped;		/* events not queued since the last report */
+	int ref;
+};
+
+/*
+ * The jobs of one context: heynoti_close() marks it dead, so queued
+ * jobs are dropped, and waits for the callbacks already called.
+ */
+struct noti_pool {
+	GMutex lock;
+	GCond cond;
+	int running;		/* callbacks being called */
+	int dead;
+	int ref;		/* the context and each queued job */
+};
+
+struct noti_job {
+	void (*cb) (void *);
+	void *cb_data;
+	int flags;
+	int count;
+	struct noti_pool *pool;
+};
+
+typedef void (*heynoti_batch_cb) (const struct heynoti_event *, int, void *);
+typedef void (*heynoti_pattern_cb) (const char *, void *);
+typedef void (*heynoti_data_cb) (const void *, int, void *);
+
 struct noti_slot {
+	struct noti_slot *next;	/* in its noti_wd, or the slab free list */
+	int id;			/* subscription id, kept across reuse */
 	int wd;
 	void *cb_data;
 	void (*cb) (void *);
 	uint32_t mask;
+	int flags;
+	const char *noti;	/* notification name, in nc->names */
+	int n_pending;		/* events folded in the current batch */
+	uint32_t ev_mask;	/* union of the folded event masks */
+	int dead;		/* unsubscribed */
+	int ref;		/* held by the subscription table and timers */
+
+	int window;		/* throttle/debounce window (msec) */
+	gint64 next_at;		/* throttle: earliest next delivery */
+	gint64 due;		/* held events are delivered at this time */
+	int n_held;		/* events held by the window */
+	uint32_t held_mask;
+
+	struct noti_queue *q;	/* key queue for NS_POOL */
+	struct noti_payload *payload;	/* NS_DATA: the key file, mapped */
 };
 typedef struct noti_slot nslot;
 
+/* all slots sharing one watch descriptor */
+struct noti_wd {
+	struct noti_wd *next;	/* in the slab free list */
+	int wd;
+	uint32_t mask;		/* mask of the kernel watch */
+	const char *path;	/* one of the n_path paths naming the watch */
+	int n_path;
+	struct noti_slot *ns;	/* in subscription order */
+	struct noti_slot *last;
+	int n;
+	struct noti_queue *q;	/* shared by the pool slots of this wd */
+};
+
+#define SLAB_CHUNK	256	/* objects per slab chunk */
+
+/*
+ * Fixed size objects of one context. Objects start with their free
+ * list link and keep the rest of their contents while free. Allocation
+ * happens under nc->lock; objects may be freed from any thread once
+ * their last reference goes.
+ */
+struct noti_slab {
+	size_t size;
+	void *free;
+	GPtrArray *chunks;
+	void (*init) (void *p, unsigned int index);	/* on a new chunk */
+};
+
+/* subscription ids: slot index and a generation bumped on reuse */
+#define ID_INDEX_BITS	20
+#define ID_INDEX_MASK	((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_ONE	(1 << ID_INDEX_BITS)
+#define ID_GEN_MASK	(0x7fffffff & ~ID_INDEX_MASK)
+
+/*
+ * Dispatch reads an immutable snapshot of the subscription table:
+ * wd -> struct snap_wd, split in shards of wd-sorted arrays. Writers
+ * copy the shard they change under nc->lock, swap the snapshot pointer
+ * and retire the old one, which is freed once no dispatch is running.
+ */
+struct snap_ent {
+	uint32_t mask;		/* copy of t->mask, checked before t */
+	struct noti_slot *t;
+};
+
+struct snap_wd {
+	int ref;		/* snapshots sharing this bucket */
+	int wd;
+	uint32_t mask;
+	int n;
+	struct snap_ent ent[];
+};
+
+#define SNAP_SHARDS	64
+
+struct snap_shard {
+	int ref;		/* snapshots sharing this shard */
+	int n;
+	struct {
+		int wd;
+		struct snap_wd *b;
+	} e[];
+};
+
+struct noti_snap {
+	struct snap_shard *sh[SNAP_SHARDS];
+};
+
+/*
+ * Pattern subscriptions share one trie of their globs, run as an NFA
+ * over the event name: the states alive after a character are bounded
+ * by the trie, not by the number of patterns. Results are cached per
+ * name, so a name seen before costs one hash lookup.
+ */
+#define PAT_ANY		256	/* '?' */
+#define PAT_STAR	257	/* '*' */
+#define PAT_CACHE_MAX	1024	/* names cached before the cache restarts */
+
+struct pat_node {
+	int c;			/* char, PAT_ANY or PAT_STAR leading here */
+	int child;		/* first child, or -1 */
+	int sibling;		/* next child of the parent, or -1 */
+	int star;		/* the PAT_STAR child, or -1 */
+	GPtrArray *acc;		/* slots whose pattern ends here */
+};
+
+/* immutable once published, but for the dispatch-only scratch */
+struct pat_matcher {
+	int n;
+	struct pat_node *nodes;
+	GHashTable *cache;	/* name -> GPtrArray of slots */
+	unsigned int *mark;	/* node -> gen it was added to a set */
+	unsigned int gen;
+	GArray *cur;
+	GArray *next;
+};
+
+/* watches of noti_root and its shard directories, sorted */
+struct noti_roots {
+	int n;
+	int wd[];
+};
+
+/*
+ * Key registry: an open addressed table of the keys of noti_root in a
+ * file every process maps. Writers hold its flock; entries are
+ * seqlocked, so readers take no lock at all. The file never changes
+ * size: growing or rebuilding writes a new one, renamed over it, and
+ * marks the old one replaced for the processes still mapping it.
+ */
+#define REG_FILE	NOTI_META "registry"
+#define REG_MAGIC	0x48524547	/* "HREG" */
+#define REG_VERSION	1
+#define REG_SLOTS_MIN	1024		/* power of two */
+#define REG_NAME_MAX	95
+#define REG_RETRY	1		/* seconds before a missing registry is
+					   looked up again */
+
+enum {
+	REG_EMPTY = 0,
+	REG_USED,
+	REG_DELETED,
+};
+
+struct reg_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t n_slots;
+	uint32_t n_used;
+	uint32_t n_deleted;
+	uint32_t replaced;	/* a newer registry was renamed over this one */
+	uint32_t pad[10];
+};
+
+struct reg_ent {
+	uint32_t seq;		/* odd while the entry is written */
+	uint32_t state;
+	uint32_t hash;
+	uint32_t mode;
+	int64_t created;	/* usec of the realtime clock */
+	int64_t published;
+	char name[REG_NAME_MAX + 1];
+};
+
+struct reg_map {
+	int fd;
+	int writable;
+	size_t size;
+	struct reg_hdr *h;
+};
+
+/*
+ * Payload of a key, written by heynoti_publish_data() through a mapping
+ * and read by subscribers through theirs. It is kept in a file of its
+ * own, next to the key file, which only the library opens: publishers
+ * of other libraries truncate key files. The file is only ever grown
+ * to PAYLOAD_SIZE, so a mapping never faults past the end.
+ */
+#define PAYLOAD_MAGIC	0x31415048	/* "HPA1", the layout version */
+#define PAYLOAD_SIZE	4096
+#define PAYLOAD_PREFIX	NOTI_META "data_"
+
+struct noti_payload {
+	uint32_t magic;
+	uint32_t seq;		/* odd while written */
+	uint32_t len;
+	uint32_t reserved;
+	char data[HEYNOTI_PAYLOAD_MAX];
+};
+
+/*
+ * Shared memory backend: a key is a
+ * slot of one segment in noti_root counting its publishes. Publishing
+ * bumps the count, the count of its group and the bell, and wakes the
+ * futex of the bell if a context waits on it. The key is looked up in
+ * the registry, its file is only opened for inotify subscribers with
+ * HEYNOTI_KEY_FILES=1. Each context has a thread sleeping on the bell
+ * that makes its fd readable; dispatch then looks for the counts that
+ * moved in the groups that moved. Slots are never freed.
+ */
+#define SHM_FILE	NOTI_META "shm"
+#define SHM_MAGIC	0x4d485348	/* "HSHM" */
+#define SHM_SLOTS	4096		/* power of two */
+#define SHM_GROUP_BITS	6		/* 64 slots a group */
+#define SHM_GROUPS	(SHM_SLOTS >> SHM_GROUP_BITS)
+#define SHM_NAME_MAX	119
+
+enum {
+	SHM_EMPTY = 0,
+	SHM_USED,
+};
+
+struct shm_hdr {
+	uint32_t magic;
+	uint32_t n_slots;
+	uint32_t bell;		/* bumped by every publish, a futex */
+	uint32_t waiters;	/* threads sleeping on the bell */
+	uint32_t pad[12];
+	uint32_t group[SHM_GROUPS];	/* publishes to the slots of a group */
+	uint32_t seq[SHM_SLOTS];	/* publishes to a slot */
+};
+
+struct shm_slot {
+	uint32_t state;		/* set once, the name is fixed from then */
+	uint32_t hash;
+	char name[SHM_NAME_MAX + 1];
+};
+
+#ifdef HAVE_IO_URING
+/*
+ * io_uring backend: inotify, with the open and close of a publish
+ * chained in one submission on a direct descriptor, and the reads of
+ * a drain made through the ring. One ring a process.
+ */
+#define URING_SLOTS	32	/* direct descriptors, one a key of a batch */
+#define URING_ENTRIES	(2 * URING_SLOTS)
+
+struct uring {
+	int fd;
+	int forked;		/* inherited from the parent */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *ring;
+	size_t ring_size;
+	size_t sqes_size;
+};
+#endif
+
+struct noti_cont;
+typedef void (*retire_fn) (struct noti_cont *nc, void *p);
+typedef ssize_t (*read_fn) (int fd, void *buf, size_t size);
+
+/*
+ * A transport of events. A context keeps the backend of the process
+ * when it is made, publishers use the backend of their process.
+ */
+struct noti_backend {
+	const char *name;
+	int named;		/* events carry key names, not watches */
+
+	/* once per process before first use, -1 if unusable */
+	int (*setup) (void);
+	/* returns the fd of nc, which the caller polls */
+	int (*init) (struct noti_cont *nc);
+	/* before the fd of nc is closed */
+	void (*fini) (struct noti_cont *nc);
+	/* returns the wd events of noti, at notipath, come with */
+	int (*watch) (struct noti_cont *nc, const char *noti,
+		      const char *notipath, uint32_t mask);
+	int (*unwatch) (struct noti_cont *nc, int wd);
+	/* of named backends, events of every key while patterns exist */
+	int (*watch_all) (struct noti_cont *nc, int on);
+	int (*publish) (const char *noti);
+	/* optional, errno or 0 by key in err */
+	void (*publish_many) (const char *const *names, int n, int *err);
+	/* dispatches the pending events of fd, nc may be NULL */
+	int (*drain) (int fd, struct noti_cont *nc);
+};
+
+/* what bulk unsubscribe removes */
+struct slot_key {
+	void (*cb) (void *);
+	void *data;
+	const char *prefix;
+	size_t len;
+	const char *noti;	/* directory mode: the name, too */
+};
+
+typedef int (*slot_match_fn) (struct noti_slot *t, const void *key);
+
+struct noti_retired {
+	struct noti_retired *next;
+	retire_fn free;
+	void *p;
+};
+
 static int __make_noti_root(const char *p);
 static int __make_noti_file(const char *p);
 static inline int __make_noti_path(char *path, int size, const char *name);
 static int __read_proc(const char *path, char *buf, int size);
 static int __get_kern_ver();
-static void __clear_nslot_list(GList *g_ns);
+static struct noti_queue *__queue_ref(struct noti_queue *q);
+static void __queue_unref(struct noti_queue *q);
+static void __pool_run(gpointer data, gpointer user_data);
+static int __pool_push(struct noti_cont *nc, struct noti_slot *t, int count);
+static void __pool_close(struct noti_pool *pc);
+static void __slab_init(struct noti_slab *s, size_t size,
+			void (*init) (void *p, unsigned int index));
+static void *__slab_alloc(struct noti_slab *s);
+static void __slab_free(struct noti_slab *s, void *p);
+static void __slab_destroy(struct noti_slab *s);
+static void __snap_free(struct noti_snap *snap);
 static struct noti_cont *__get_noti_cont(int fd);
-static int __handle_callback(struct noti_cont *nc, int wd, uint32_t mask);
+static void __set_noti_cont(int fd, struct noti_cont *nc);
+static void __slot_unref(struct noti_cont *nc, struct noti_slot *t);
+static void __free_noti_wd(struct noti_cont *nc, struct noti_wd *w);
+static void __publish(struct noti_cont *nc, int wd);
+static void __publish_dirty(struct noti_cont *nc);
+static void __retire(struct noti_cont *nc, void *p, retire_fn free);
+static void __reclaim(struct noti_cont *nc);
+static void __enter_dispatch(struct noti_cont *nc);
+static void __leave_dispatch(struct noti_cont *nc);
+static void __free_noti_cont(struct noti_cont *nc);
+static inline struct noti_wd *__get_noti_wd(struct noti_cont *nc, int wd);
+static int __handle_callback(struct noti_cont *nc, int wd, uint32_t mask,
+			     const char *name);
+static int __fill_event_buf(struct noti_cont *nc);
+static void __deliver(struct noti_cont *nc, struct noti_slot *t,
+		      uint32_t mask, int count);
+static void __hold(struct noti_cont *nc, struct noti_slot *t,
+		   uint32_t mask, gint64 due);
+static void __deliver_data(struct noti_slot *t, uint32_t mask);
+static int __arm_timer(struct noti_cont *nc);
+static int __handle_timer(int fd);
+static void __flush_batch(struct noti_cont *nc, guint i);
+static void __flush_pending(struct noti_cont *nc);
+static void __flush_fired(struct noti_cont *nc);
+static void __pat_free(struct pat_matcher *m);
+static int __sync_patterns(struct noti_cont *nc);
+static void __handle_pattern(struct noti_cont *nc, uint32_t mask,
+			     const char *name);
+static void __handle_root(struct noti_cont *nc, struct inotify_event *ie);
+static struct noti_roots *__watch_roots(struct noti_cont *nc);
+static void __reshard_roots(struct noti_cont *nc);
+static int __sharded(void);
+static int __alt_noti_path(char *path, int size, const char *notipath);
+static int __add_watch(int fd, const char *notipath, uint32_t mask);
+static void __reg_touch(const char *noti);
+static int __reg_has(const char *noti);
+static int __del_patterns(struct noti_cont *nc, slot_match_fn match,
+			  const void *key);
 static int __handle_event(int fd);
-static inline int __get_wd(int fd, const char *notipath);
-static int __add_wd(struct noti_cont *nc, int wd, uint32_t mask,
-		  const char *notipath);
-static int __add_noti(int fd, const char *notipath, void (*cb) (void *),
-		    void *data, uint32_t mask);
-static int _del_noti(struct noti_cont *nc, int wd, void (*cb) (void *),
-		     const char *notipath);
-static int del_noti(int fd, const char *notipath, void (*cb) (void *));
+static void __bind_path(struct noti_cont *nc, struct noti_wd *w,
+			const char *notipath);
+static void __unlink_paths(struct noti_cont *nc, struct noti_wd *w);
+static void __forget_wd(struct noti_cont *nc, int wd);
+static int __sync_wd(struct noti_cont *nc, struct noti_wd *w, uint32_t mask);
+static int __add_slot(struct noti_cont *nc, const char *noti,
+		      const char *notipath, void (*cb) (void *), void *data,
+		      uint32_t mask, int flags);
+static int __add_noti(int fd, const char *noti, const char *notipath,
+		    void (*cb) (void *), void *data, uint32_t mask, int flags);
+static int __del_slots(struct noti_cont *nc, struct noti_wd *w,
+		       slot_match_fn match, const void *key);
+static int __match_slot(struct noti_slot *t, const void *key);
+static int _del_noti(struct noti_cont *nc, struct noti_wd *w,
+		     const char *noti, void (*cb) (void *));
+static int del_noti(int fd, const char *noti, const char *notipath,
+		    void (*cb) (void *));
+static struct noti_slot *__find_slot(struct noti_cont *nc, const char *noti,
+				     const char *notipath,
+				     void (*cb) (void *));
+static int __init_cont(int dir);
+static int __init_timer(struct noti_cont *nc);
+static int __attach_timer(struct noti_cont *nc);
+static int __set_window(int fd, const char *noti, void (*cb) (void *),
+			int msec, int flag);
 
 
 int slot_comp(struct noti_slot *a, struct noti_slot *b)
@@ -96,7 +556,21 @@ typedef enum {
 
 struct noti_cont {
 	int fd;
-	GList *g_ns;
+	int dir_mode;		/* routes noti_root events by name */
+	struct noti_roots *roots;	/* for directory mode or patterns */
+	GPtrArray *pats;	/* pattern slots, under lock */
+	struct pat_matcher *pat;	/* read by dispatch */
+	GMutex lock;		/* serializes subscription changes */
+	GHashTable *wd_tbl;	/* wd -> struct noti_wd, under lock */
+	GHashTable *path_tbl;	/* noti path -> struct noti_wd, under lock */
+	struct noti_slab slots;
+	struct noti_slab wds;
+	GStringChunk *names;	/* noti names of the slots, under lock */
+	struct noti_snap *snap;	/* read by dispatch */
+	GArray *dirty;		/* wds changed since snap, under lock */
+	int deferring;		/* inside a bulk call, under lock */
+	int readers;		/* dispatches using a snapshot */
+	struct noti_retired *retired;
 
 	htype ht;
 
@@ -104,11 +578,68 @@ struct noti_cont {
 	struct sigaction oldact;
 
 	void *handler;
+
+	char *buf;		/* inotify read buffer */
+	int buf_size;		/* allocated size of buf */
+	int buf_fixed;		/* size set by heynoti_set_event_buffer() */
+	int buf_want;		/* size it asked for, -1 once taken up */
+	int n_event;		/* events returned by the last read */
+
+	GPtrArray *pending;	/* coalesced slots fired in this batch */
+	GArray *events;		/* records handed to batch callbacks */
+	GPtrArray *fired;	/* one-shot slots delivered in this batch */
+
+	int dispatching;	/* nesting of the dispatching thread */
+	int closing;		/* closed from a callback */
+	struct noti_pool *pool;	/* jobs of NS_POOL slots, under lock */
+
+	int tfd;		/* timerfd for throttle/debounce windows */
+	gint64 armed;		/* expiry the timer is armed for, 0 if idle */
+	GPtrArray *timers;	/* slots holding events */
+
+	const struct noti_backend *be;
+
+	struct shm_hdr *shm;	/* shm backend: fd is an eventfd */
+	uint32_t *shm_seen;	/* slot and group counts at the last dispatch */
+	GThread *shm_thread;	/* waits on the bell */
+	uint32_t shm_bell;	/* the bell the thread last saw */
+	int shm_stop;
+
+	int bk_sock;		/* broker backend: fd is an epoll fd of it */
+	int bk_ino;		/* and of this, seeing heynotid bind again */
 };
 typedef struct noti_cont ncont;
 
 static const char *noti_root = NOTI_ROOT;
-static GList *g_nc;
+static int sharded = -1;	/* layout of noti_root, -1 until looked up */
+static int root_fd = -1;	/* noti_root, for batched publishes */
+
+static GThreadPool *pool;
+static int pool_threads = POOL_THREADS_DEFAULT;
+G_LOCK_DEFINE_STATIC(pool);
+static GPrivate pool_self = G_PRIVATE_INIT(NULL);	/* pool of the job */
+
+static const struct noti_backend *backend;	/* NULL until looked up */
+G_LOCK_DEFINE_STATIC(backend);
+
+static struct shm_hdr *shm;
+static int shm_fd = -1;
+G_LOCK_DEFINE_STATIC(shm);
+
+static int broker_fd = -1;	/* publishes to heynotid */
+
+#ifdef HAVE_IO_URING
+static struct uring uring = { .fd = -1 };
+G_LOCK_DEFINE_STATIC(uring);
+#endif
+
+/*
+ * Contexts are indexed directly by fd; fds beyond the table go to
+ * the overflow hash.
+ */
+#define NC_TBL_SIZE 1024
+static struct noti_cont *nc_tbl[NC_TBL_SIZE];
+static GHashTable *nc_ovf;
 
 static int __make_noti_root(const char *p)
 {
@@ -134,11 +665,179 @@ static int __make_noti_file(const char *p)
 	return 0;
 }
 
+/* looks the layout of noti_root up again */
+static int __lookup_sharded(void)
+{
+	char path[FILENAME_MAX];
+	int r;
+
+	snprintf(path, sizeof(path), "%s/%s", noti_root, NOTI_SHARD_MARKER);
+	r = access(path, F_OK) == 0;
+	g_atomic_int_set(&sharded, r);
+
+	return r;
+}
+
+/*
+ * Looked up once. A later migration is covered by __alt_noti_path(),
+ * and seen by the noti_root watches when the marker is made.
+ */
+static int __sharded(void)
+{
+	int r;
+
+	r = g_atomic_int_get(&sharded);
+	if (r == -1)
+		r = __lookup_sharded();
+
+	return r;
+}
+
+/* FNV-1a, fixed since every process must agree on it */
+static uint32_t __fnv1a(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static inline unsigned int __shard_of(const char *name)
+{
+	return __fnv1a(name) % NOTI_SHARDS;
+}
+
+/*
+ * Seqlocks of shared mappings: seq is odd while a writer holds it.
+ * Writers of other processes may die holding it, so waits are bounded;
+ * with force, the lock is taken over after the wait.
+ */
+#define SEQ_SPINS	100000
+
+static int __seq_lock(uint32_t *seq, int force)
+{
+	uint32_t s = 0;
+	int i;
+
+	for (i = 0; i < SEQ_SPINS; i++) {
+		s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+		if (!(s & 1) &&
+		    __atomic_compare_exchange_n(seq, &s, s + 1, 0,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return 0;
+		if (i > 64)
+			sched_yield();
+	}
+
+	if (!force)
+		return -1;
+	__atomic_store_n(seq, s | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+static inline void __seq_unlock(uint32_t *seq)
+{
+	__atomic_store_n(seq, __atomic_load_n(seq, __ATOMIC_RELAXED) + 1,
+			 __ATOMIC_RELEASE);
+}
+
+/* waits for no writer, -1 and EAGAIN if one stays */
+static int __seq_begin(const uint32_t *seq, uint32_t *s)
+{
+	int i;
+
+	for (i = 0; i < SEQ_SPINS; i++) {
+		*s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		if (!(*s & 1))
+			return 0;
+		if (i > 64)
+			sched_yield();
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+/* whether what was read since __seq_begin() may be torn */
+static inline int __seq_retry(const uint32_t *seq, uint32_t s)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) != s;
+}
+
 static inline int __make_noti_path(char *path, int size, const char *name)
 {
+	if (__sharded())
+		return snprintf(path, size, "%s/%02x/%s", noti_root,
+				__shard_of(name), name);
+
 	return snprintf(path, size, "%s/%s", noti_root, name);
 }
 
+/* the path of the key file of name from noti_root */
+static inline int __rel_noti_path(char *path, int size, const char *name)
+{
+	if (__sharded())
+		return snprintf(path, size, "%02x/%s", __shard_of(name), name);
+
+	return snprintf(path, size, "%s", name);
+}
+
+/*
+ * The path of notipath in the other layout: the flat one for a file
+ * not migrated yet, or the sharded one if noti_root was migrated after
+ * this process looked it up. -1 if there is none.
+ */
+static int __alt_noti_path(char *path, int size, const char *notipath)
+{
+	char marker[FILENAME_MAX];
+	size_t len = strlen(noti_root);
+	const char *name;
+
+	if (strncmp(notipath, noti_root, len) != 0 || notipath[len] != '/')
+		return -1;
+	name = notipath + len + 1;
+
+	if (__sharded()) {
+		name = strchr(name, '/');
+		if (name == NULL)
+			return -1;
+		return snprintf(path, size, "%s%s", noti_root, name) < size ?
+		    0 : -1;
+	}
+
+	snprintf(marker, sizeof(marker), "%s/%s", noti_root,
+		 NOTI_SHARD_MARKER);
+	if (access(marker, F_OK) == -1)
+		return -1;
+
+	return snprintf(path, size, "%s/%02x/%s", noti_root,
+			__shard_of(name), name) < size ? 0 : -1;
+}
+
+static int __add_watch(int fd, const char *notipath, uint32_t mask)
+{
+	char alt[FILENAME_MAX];
+	int wd;
+
+	wd = inotify_add_watch(fd, notipath, mask);
+	if (wd == -1 && errno == ENOENT) {
+		if (__alt_noti_path(alt, sizeof(alt), notipath) == 0)
+			wd = inotify_add_watch(fd, alt, mask);
+		else
+			errno = ENOENT;
+	}
+
+	return wd;
+}
+
 static int __read_proc(const char *path, char *buf, int size)
 {
 	int fd;
@@ -193,385 +892,4721 @@ static int __get_kern_ver()
 	return -1;
 }
 
-static void __clear_nslot_list(GList *g_ns)
+static struct noti_queue *__queue_ref(struct noti_queue *q)
 {
-	struct noti_slot *t;
-	GList *it = NULL;
+	g_atomic_int_inc(&q->ref);
+	return q;
+}
 
-	for (it = g_ns; it != NULL; it = g_list_next(it)) {
-		t = (struct noti_slot *)it->data;
-		free(t);
-	}
+static void __queue_unref(struct noti_queue *q)
+{
+	if (q == NULL || !g_atomic_int_dec_and_test(&q->ref))
+		return;
 
+	g_mutex_clear(&q->lock);
+	free(q);
 }
 
-static struct noti_cont *__get_noti_cont(int fd)
+static void __pool_unref(struct noti_pool *pc)
 {
-	struct noti_cont *r = NULL;
-	GList *it;
-
-	for (it = g_nc; it != NULL; it = g_list_next(it)) {
-		if (it->data) {
-			r = (struct noti_cont *)it->data;
-			if (r->fd == fd) {
-				break;
-			} else {
-				r = NULL;
-			}
-		}
-	}
+	if (!g_atomic_int_dec_and_test(&pc->ref))
+		return;
 
-	return r;
+	g_cond_clear(&pc->cond);
+	g_mutex_clear(&pc->lock);
+	free(pc);
 }
 
-static int __handle_callback(struct noti_cont *nc, int wd, uint32_t mask)
+/* whether the job may call back, counted as running if so */
+static int __pool_enter(struct noti_pool *pc)
 {
-	struct noti_slot *t;
-	GList *it = NULL;
-
-	if (!nc->g_ns)
-		return 0;
+	int dead;
 
-	for (it = nc->g_ns; it != NULL; it = g_list_next(it)) {
-		t = (struct noti_slot *)it->data;
-		if (t->wd == wd) {
-			if ((mask & t->mask) && t->cb) {
-				t->cb(t->cb_data);
-			}
-		}
-	}
+	g_mutex_lock(&pc->lock);
+	dead = pc->dead;
+	if (!dead)
+		pc->running++;
+	g_mutex_unlock(&pc->lock);
 
-	return 0;
+	return !dead;
 }
 
-static int __handle_event(int fd)
+static void __pool_leave(struct noti_pool *pc)
 {
-	int r;
-	struct inotify_event ie;
-	char name[FILENAME_MAX];
+	g_mutex_lock(&pc->lock);
+	pc->running--;
+	g_cond_broadcast(&pc->cond);
+	g_mutex_unlock(&pc->lock);
+}
 
-	struct noti_cont *nc;
+/* no callback of pc runs once this returns, but the one calling it */
+static void __pool_close(struct noti_pool *pc)
+{
+	int self;
 
-	nc = __get_noti_cont(fd);
-	util_warn_if(nc == NULL, "Non-registered file descriptor");
+	if (pc == NULL)
+		return;
 
-	r = read(fd, &ie, sizeof(ie));
+	self = g_private_get(&pool_self) == pc;
 
-	while (r > 0) {
-		if (nc)
-			__handle_callback(nc, ie.wd, ie.mask);
+	g_mutex_lock(&pc->lock);
+	pc->dead = 1;
+	while (pc->running > self)
+		g_cond_wait(&pc->cond, &pc->lock);
+	g_mutex_unlock(&pc->lock);
 
-		if (ie.len > 0)
-			read(fd, name, ie.len);
+	__pool_unref(pc);
+}
 
-		r = read(fd, &ie, sizeof(ie));
+static void __pool_run(gpointer data, gpointer user_data)
+{
+	struct noti_queue *q = data;
+	struct noti_job *j;
+
+	for (;;) {
+		g_mutex_lock(&q->lock);
+		j = g_queue_pop_head(&q->jobs);
+		if (j == NULL)
+			q->running = 0;
+		g_mutex_unlock(&q->lock);
+
+		if (j == NULL)
+			break;
+
+		if (__pool_enter(j->pool)) {
+			g_private_set(&pool_self, j->pool);
+			if (j->flags & NS_COALESCE)
+				((void (*)(void *, int))j->cb) (j->cb_data,
+								j->count);
+			else
+				j->cb(j->cb_data);
+			g_private_set(&pool_self, NULL);
+			__pool_leave(j->pool);
+		}
+		__pool_unref(j->pool);
+		free(j);
 	}
 
-	return 0;
+	__queue_unref(q);
 }
 
-API int heynoti_poll_event(int fd)
+/*
+ * Past POOL_QUEUE_MAX jobs of a key, a coalesced event is added to the
+ * last job of its slot, others are dropped and reported.
+ */
+static int __pool_push(struct noti_cont *nc, struct noti_slot *t, int count)
 {
-	int r;
-	struct noti_cont *nc;
-	struct pollfd fds[1];
+	struct noti_queue *q = t->q;
+	struct noti_job *j;
+	struct noti_job *last;
+	GThreadPool *p;
 
-	nc = __get_noti_cont(fd);
-	if (nc == NULL) {
-		UTIL_ERR("Non-registered file descriptor : %d", fd);
+	/* closed from a callback, the rest of the dispatch calls nothing */
+	if (nc->pool == NULL) {
 		errno = EBADF;
 		return -1;
 	}
 
-	if (nc->ht != H_NONE) {
-		UTIL_ERR("Another handler already in progress");
-		errno = EALREADY;
+	G_LOCK(pool);
+	if (pool == NULL)
+		pool = g_thread_pool_new(__pool_run, NULL, pool_threads,
+					 FALSE, NULL);
+	p = pool;
+	G_UNLOCK(pool);
+	util_retvm_if(p == NULL, -1, "Error: create worker pool");
+
+	j = malloc(sizeof(struct noti_job));
+	util_retvm_if(j == NULL, -1, "Error: pool job: %s", strerror(errno));
+
+	j->cb = t->cb;
+	j->cb_data = t->cb_data;
+	j->flags = t->flags;
+	j->count = count;
+
+	g_mutex_lock(&q->lock);
+	if (g_queue_get_length(&q->jobs) >= POOL_QUEUE_MAX) {
+		last = g_queue_peek_tail(&q->jobs);
+		if ((j->flags & NS_COALESCE) && last->cb == j->cb &&
+		    last->cb_data == j->cb_data)
+			last->count += count;
+		else if (q->dropped++ == 0)
+			UTIL_ERR("Error: pool: queue of %s full", t->noti);
+		g_mutex_unlock(&q->lock);
+		free(j);
+		errno = EAGAIN;
 		return -1;
 	}
+	if (q->dropped) {
+		UTIL_ERR("Error: pool: %d events of %s dropped, queue full",
+			 q->dropped, t->noti);
+		q->dropped = 0;
+	}
 
-	fds[0].fd = nc->fd;
-	fds[0].events = POLLIN;
+	j->pool = nc->pool;
+	g_atomic_int_inc(&j->pool->ref);
+	g_queue_push_tail(&q->jobs, j);
+	if (!q->running) {
+		q->running = 1;
+		g_thread_pool_push(p, __queue_ref(q), NULL);
+	}
+	g_mutex_unlock(&q->lock);
 
-	r = poll(fds, 1, -1);
-	util_retvm_if(r == -1, -1, "Error: poll : %s", strerror(errno));
+	return 0;
+}
 
-	if (fds[0].revents & POLLIN)
-		__handle_event(fd);
+static void __slab_init(struct noti_slab *s, size_t size,
+			void (*init) (void *p, unsigned int index))
+{
+	s->size = size;
+	s->free = NULL;
+	s->chunks = g_ptr_array_new();
+	s->init = init;
+}
 
-	return r;
+/* with nc->lock held, so there is a single popper and no ABA */
+static void *__slab_alloc(struct noti_slab *s)
+{
+	char *c;
+	void *p;
+	int i;
+
+	do {
+		p = g_atomic_pointer_get(&s->free);
+		if (p == NULL)
+			break;
+	} while (!g_atomic_pointer_compare_and_exchange(&s->free, p,
+							*(void **)p));
+
+	if (p == NULL) {
+		c = calloc(SLAB_CHUNK, s->size);
+		if (c == NULL)
+			return NULL;
+
+		for (i = 0; s->init && i < SLAB_CHUNK; i++)
+			s->init(c + i * s->size, s->chunks->len * SLAB_CHUNK + i);
+		g_ptr_array_add(s->chunks, c);
+
+		for (i = 1; i < SLAB_CHUNK; i++)
+			__slab_free(s, c + i * s->size);
+		p = c;
+	}
+
+	return p;
+}
+
+static inline void *__slab_get(struct noti_slab *s, unsigned int index)
+{
+	if (index / SLAB_CHUNK >= s->chunks->len)
+		return NULL;
+
+	return (char *)g_ptr_array_index(s->chunks, index / SLAB_CHUNK) +
+	    (index % SLAB_CHUNK) * s->size;
 }
 
-static inline int __get_wd(int fd, const char *notipath)
+static void __slab_free(struct noti_slab *s, void *p)
 {
-	return inotify_add_watch(fd, notipath, IN_ACCESS);
+	do {
+		*(void **)p = g_atomic_pointer_get(&s->free);
+	} while (!g_atomic_pointer_compare_and_exchange(&s->free,
+							*(void **)p, p));
 }
 
-static int __add_wd(struct noti_cont *nc, int wd, uint32_t mask,
-		    const char *notipath)
+static void __slab_destroy(struct noti_slab *s)
+{
+	g_ptr_array_foreach(s->chunks, (GFunc) free, NULL);
+	g_ptr_array_free(s->chunks, TRUE);
+	s->chunks = NULL;
+	s->free = NULL;
+}
+
+static void __slot_init(void *p, unsigned int index)
+{
+	/* slots beyond the id space are never handed out */
+	((struct noti_slot *)p)->id = index <= ID_INDEX_MASK ? (int)index : -1;
+}
+
+/* with nc->lock held */
+static struct noti_slot *__slot_new(struct noti_cont *nc)
 {
-	int r;
-	uint32_t mask_all;
 	struct noti_slot *t;
-	GList *it;
+	int id;
 
-	mask_all = 0;
-	for (it = nc->g_ns; it != NULL; it = g_list_next(it)) {
-		t = (struct noti_slot *)it->data;
-		if (t->wd == wd) {
-			mask_all |= t->mask;
-		}
+	t = __slab_alloc(&nc->slots);
+	if (t == NULL)
+		return NULL;
+
+	if (t->id == -1) {
+		errno = ENOSPC;
+		return NULL;
 	}
 
-	mask_all |= mask;
+	/* a new generation, so ids of the previous owner go stale */
+	id = t->id;
+	memset(t, 0, sizeof(struct noti_slot));
+	t->id = (id & ID_INDEX_MASK) | ((id + ID_GEN_ONE) & ID_GEN_MASK);
 
-	r = inotify_add_watch(nc->fd, notipath, mask_all);
-	return r;
+	return t;
 }
 
-static int __add_noti(int fd, const char *notipath, void (*cb) (void *),
-		      void *data, uint32_t mask)
+/* with nc->lock held */
+static struct noti_slot *__slot_by_id(struct noti_cont *nc, int id)
+{
+	struct noti_slot *t;
+
+	if (id < 0)
+		return NULL;
+
+	t = __slab_get(&nc->slots, id & ID_INDEX_MASK);
+	if (t == NULL || t->id != id || t->dead)
+		return NULL;
+
+	return t;
+}
+
+static inline struct noti_wd *__get_noti_wd(struct noti_cont *nc, int wd)
+{
+	return g_hash_table_lookup(nc->wd_tbl, GINT_TO_POINTER(wd));
+}
+
+/*
+ * Directory mode keys noti_wd and the snapshot by a hash of the name
+ * instead of a kernel wd. Names colliding on a key share it, so their
+ * slots are told apart by name.
+ */
+static inline int __dir_key(const char *name)
+{
+	return g_str_hash(name) & G_MAXINT;
+}
+
+static inline int __is_noti(struct noti_cont *nc, struct noti_slot *t,
+			    const char *noti)
+{
+	return !nc->dir_mode || strcmp(t->noti, noti) == 0;
+}
+
+static void __slot_unref(struct noti_cont *nc, struct noti_slot *t)
+{
+	if (g_atomic_int_dec_and_test(&t->ref)) {
+		if (t->payload)
+			munmap(t->payload, PAYLOAD_SIZE);
+		__queue_unref(t->q);
+		__slab_free(&nc->slots, t);
+	}
+}
+
+/* with nc->lock held, after the last slot of w went */
+static void __free_noti_wd(struct noti_cont *nc, struct noti_wd *w)
+{
+	__unlink_paths(nc, w);
+	g_hash_table_remove(nc->wd_tbl, GINT_TO_POINTER(w->wd));
+	__queue_unref(w->q);
+	__slab_free(&nc->wds, w);
+}
+
+static void __snap_wd_unref(struct snap_wd *b)
+{
+	if (g_atomic_int_dec_and_test(&b->ref))
+		g_free(b);
+}
+
+static void __snap_shard_unref(struct snap_shard *sh)
+{
+	int i;
+
+	if (sh == NULL || !g_atomic_int_dec_and_test(&sh->ref))
+		return;
+
+	for (i = 0; i < sh->n; i++)
+		__snap_wd_unref(sh->e[i].b);
+	g_free(sh);
+}
+
+static void __snap_free(struct noti_snap *snap)
+{
+	int i;
+
+	for (i = 0; i < SNAP_SHARDS; i++)
+		__snap_shard_unref(snap->sh[i]);
+	g_free(snap);
+}
+
+static inline struct snap_shard **__snap_shard(struct noti_snap *snap,
+					       int wd)
+{
+	return &snap->sh[(unsigned int)wd % SNAP_SHARDS];
+}
+
+static struct snap_wd *__snap_lookup(struct noti_snap *snap, int wd)
+{
+	struct snap_shard *sh;
+	int lo;
+	int hi;
+	int mid;
+
+	sh = *__snap_shard(snap, wd);
+	if (sh == NULL)
+		return NULL;
+
+	lo = 0;
+	hi = sh->n;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (sh->e[mid].wd < wd)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < sh->n && sh->e[lo].wd == wd)
+		return sh->e[lo].b;
+
+	return NULL;
+}
+
+static struct snap_wd *__snap_wd_new(struct noti_wd *w)
+{
+	struct snap_wd *b;
+	struct noti_slot *t;
+
+	b = g_malloc(sizeof(struct snap_wd) + w->n * sizeof(struct snap_ent));
+	b->ref = 1;
+	b->wd = w->wd;
+	b->mask = w->mask;
+	b->n = 0;
+	for (t = w->ns; t != NULL; t = t->next) {
+		b->ent[b->n].mask = t->mask;
+		b->ent[b->n].t = t;
+		b->n++;
+	}
+
+	return b;
+}
+
+/*
+ * Copy of old with the buckets of the sorted wds rebuilt from the
+ * master table, or dropped if they have no slot left.
+ */
+static struct snap_shard *__snap_shard_new(struct noti_cont *nc,
+					   struct snap_shard *old,
+					   const int *wds, int n_wds)
+{
+	struct snap_shard *sh;
+	struct noti_wd *w;
+	int n;
+	int i;
+	int j;
+
+	n = old ? old->n : 0;
+	sh = g_malloc(sizeof(struct snap_shard) +
+		      (n + n_wds) * sizeof(sh->e[0]));
+	sh->ref = 1;
+	sh->n = 0;
+
+	for (i = 0, j = 0; i < n || j < n_wds;) {
+		if (j == n_wds || (i < n && old->e[i].wd < wds[j])) {
+			g_atomic_int_inc(&old->e[i].b->ref);
+			sh->e[sh->n++] = old->e[i++];
+			continue;
+		}
+
+		if (i < n && old->e[i].wd == wds[j])
+			i++;
+
+		w = __get_noti_wd(nc, wds[j]);
+		if (w && w->ns) {
+			sh->e[sh->n].wd = wds[j];
+			sh->e[sh->n++].b = __snap_wd_new(w);
+		}
+		j++;
+	}
+
+	if (sh->n == 0) {
+		g_free(sh);
+		return NULL;
+	}
+
+	return sh;
+}
+
+static gint __dirty_cmp(gconstpointer a, gconstpointer b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	unsigned int sx = (unsigned int)x % SNAP_SHARDS;
+	unsigned int sy = (unsigned int)y % SNAP_SHARDS;
+
+	if (sx != sy)
+		return sx < sy ? -1 : 1;
+
+	return x < y ? -1 : x > y;
+}
+
+static void __retire_snap(struct noti_cont *nc, void *p)
+{
+	__snap_free(p);
+}
+
+static void __retire_slot(struct noti_cont *nc, void *p)
+{
+	__slot_unref(nc, p);
+}
+
+/* with nc->lock held, after the slots or the mask of wd changed */
+static void __publish(struct noti_cont *nc, int wd)
+{
+	g_array_append_val(nc->dirty, wd);
+
+	/* bulk calls publish once, when they are done */
+	if (!nc->deferring)
+		__publish_dirty(nc);
+}
+
+static void __publish_dirty(struct noti_cont *nc)
+{
+	struct noti_snap *old;
+	struct noti_snap *snap;
+	struct snap_shard **sh;
+	int *wds;
+	guint n;
+	guint i;
+	guint j;
+
+	if (nc->dirty->len == 0)
+		return;
+
+	/* group by shard, in wd order */
+	g_array_sort(nc->dirty, __dirty_cmp);
+	wds = (int *)nc->dirty->data;
+	for (i = 1, n = 1; i < nc->dirty->len; i++) {
+		if (wds[i] != wds[n - 1])
+			wds[n++] = wds[i];
+	}
+
+	old = nc->snap;
+	snap = g_malloc(sizeof(struct noti_snap));
+
+	/* untouched shards are shared with the old snapshot */
+	for (i = 0; i < SNAP_SHARDS; i++) {
+		snap->sh[i] = old->sh[i];
+		if (snap->sh[i])
+			g_atomic_int_inc(&snap->sh[i]->ref);
+	}
+
+	for (i = 0; i < n; i = j) {
+		sh = __snap_shard(snap, wds[i]);
+		for (j = i + 1; j < n && __snap_shard(snap, wds[j]) == sh; j++)
+			;
+
+		__snap_shard_unref(*sh);
+		*sh = __snap_shard_new(nc, *__snap_shard(old, wds[i]),
+				       wds + i, j - i);
+	}
+	g_array_set_size(nc->dirty, 0);
+
+	g_atomic_pointer_set(&nc->snap, snap);
+	__retire(nc, old, __retire_snap);
+}
+
+static void __retire(struct noti_cont *nc, void *p, retire_fn free)
+{
+	struct noti_retired *r;
+
+	r = g_malloc(sizeof(struct noti_retired));
+	r->free = free;
+	r->p = p;
+
+	do {
+		r->next = g_atomic_pointer_get(&nc->retired);
+	} while (!g_atomic_pointer_compare_and_exchange(&nc->retired,
+							r->next, r));
+
+	__reclaim(nc);
+}
+
+/*
+ * Everything taken off the retired list was unreachable before it was
+ * taken, so if no dispatch is running afterwards nobody can hold it.
+ */
+static void __reclaim(struct noti_cont *nc)
+{
+	struct noti_retired *list;
+	struct noti_retired *last;
+	struct noti_retired *r;
+
+	do {
+		list = g_atomic_pointer_get(&nc->retired);
+		if (list == NULL)
+			return;
+	} while (!g_atomic_pointer_compare_and_exchange(&nc->retired,
+							list, NULL));
+
+	if (g_atomic_int_get(&nc->readers) == 0) {
+		while (list) {
+			r = list;
+			list = r->next;
+			r->free(nc, r->p);
+			g_free(r);
+		}
+		return;
+	}
+
+	/* still in use, hand it to the last dispatch leaving */
+	for (last = list; last->next != NULL; last = last->next)
+		;
+	do {
+		last->next = g_atomic_pointer_get(&nc->retired);
+	} while (!g_atomic_pointer_compare_and_exchange(&nc->retired,
+							last->next, list));
+}
+
+static void __enter_dispatch(struct noti_cont *nc)
+{
+	nc->dispatching++;
+	g_atomic_int_inc(&nc->readers);
+}
+
+static void __leave_dispatch(struct noti_cont *nc)
+{
+	if (g_atomic_int_dec_and_test(&nc->readers))
+		__reclaim(nc);
+
+	if (--nc->dispatching == 0 && nc->closing)
+		__free_noti_cont(nc);
+}
+
+static struct noti_cont *__get_noti_cont(int fd)
+{
+	if (fd < 0)
+		return NULL;
+
+	if (fd < NC_TBL_SIZE)
+		return nc_tbl[fd];
+
+	if (nc_ovf == NULL)
+		return NULL;
+
+	return g_hash_table_lookup(nc_ovf, GINT_TO_POINTER(fd));
+}
+
+/* nc == NULL unregisters fd */
+static void __set_noti_cont(int fd, struct noti_cont *nc)
+{
+	if (fd < NC_TBL_SIZE) {
+		nc_tbl[fd] = nc;
+		return;
+	}
+
+	if (nc == NULL) {
+		if (nc_ovf)
+			g_hash_table_remove(nc_ovf, GINT_TO_POINTER(fd));
+		return;
+	}
+
+	if (nc_ovf == NULL)
+		nc_ovf = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	g_hash_table_insert(nc_ovf, GINT_TO_POINTER(fd), nc);
+}
+
+/* name is the noti name of a directory mode event, NULL otherwise */
+static int __handle_callback(struct noti_cont *nc, int wd, uint32_t mask,
+			     const char *name)
+{
+	struct noti_slot *t;
+	struct snap_wd *b;
+	gint64 now;
+	int flags;
+	int i;
+
+	if (nc->closing)
+		return 0;
+
+	b = __snap_lookup(g_atomic_pointer_get(&nc->snap), wd);
+	if (b == NULL || !(mask & b->mask))
+		return 0;
+
+	for (i = 0; i < b->n; i++) {
+		if (!(mask & b->ent[i].mask))
+			continue;
+
+		t = b->ent[i].t;
+		if (!t->cb || g_atomic_int_get(&t->dead))
+			continue;
+
+		if (name && strcmp(t->noti, name) != 0)
+			continue;
+
+		flags = g_atomic_int_get(&t->flags);
+		if (flags & NS_ONCE) {
+			/* claimed here, removed after the batch */
+			if (!g_atomic_int_compare_and_exchange(&t->dead, 0, 1))
+				continue;
+			g_ptr_array_add(nc->fired, t);
+			t->cb(t->cb_data);
+			continue;
+		}
+
+		if (flags & NS_WINDOW) {
+			now = g_get_monotonic_time();
+
+			if (flags & NS_DEBOUNCE) {
+				__hold(nc, t, mask, now + t->window * 1000LL);
+				continue;
+			}
+
+			if (t->n_held || now < t->next_at) {
+				__hold(nc, t, mask, t->next_at);
+				continue;
+			}
+
+			t->next_at = now + t->window * 1000LL;
+		}
+
+		__deliver(nc, t, mask, 1);
+	}
+
+	return 0;
+}
+
+static void __deliver(struct noti_cont *nc, struct noti_slot *t,
+		      uint32_t mask, int count)
+{
+	if (t->flags & (NS_COALESCE | NS_BATCH)) {
+		t->ev_mask |= mask;
+		if (t->n_pending == 0)
+			g_ptr_array_add(nc->pending, t);
+		t->n_pending += count;
+	} else if (t->flags & NS_POOL) {
+		__pool_push(nc, t, count);
+	} else if (t->flags & NS_DATA) {
+		__deliver_data(t, mask);
+	} else {
+		t->cb(t->cb_data);
+	}
+}
+
+/*
+ * The payload file of noti: in noti_root for a name, whatever the
+ * layout, or next to the file for a path.
+ */
+static int __make_data_path(char *path, int size, const char *noti)
+{
+	const char *base;
+
+	base = strrchr(noti, '/');
+	if (base == NULL)
+		return snprintf(path, size, "%s/%s%s", noti_root,
+				PAYLOAD_PREFIX, noti);
+
+	base++;
+	return snprintf(path, size, "%.*s%s%s", (int)(base - noti), noti,
+			PAYLOAD_PREFIX, base);
+}
+
+/* maps the payload file of t, once a payload was published to it */
+static struct noti_payload *__payload_map(struct noti_slot *t)
+{
+	char path[FILENAME_MAX];
+	struct stat sb;
+	void *p;
+	int fd;
+
+	if (t->payload)
+		return t->payload;
+
+	if (__make_data_path(path, sizeof(path), t->noti) >= (int)sizeof(path))
+		return NULL;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+
+	p = MAP_FAILED;
+	if (fstat(fd, &sb) == 0 && sb.st_size >= PAYLOAD_SIZE)
+		p = mmap(NULL, PAYLOAD_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	t->payload = p;
+
+	return t->payload;
+}
+
+/* calls t with a consistent copy of the payload, read without syscalls */
+static void __deliver_data(struct noti_slot *t, uint32_t mask)
+{
+	char buf[HEYNOTI_PAYLOAD_MAX];
+	struct noti_payload *p;
+	uint32_t seq;
+	uint32_t len;
+
+	/* a new file of the name is mapped on its first event */
+	if ((mask & (IN_DELETE | IN_DELETE_SELF)) && t->payload) {
+		munmap(t->payload, PAYLOAD_SIZE);
+		t->payload = NULL;
+	}
+
+	len = 0;
+	p = (mask & (IN_DELETE | IN_DELETE_SELF)) ? NULL : __payload_map(t);
+	if (p && __atomic_load_n(&p->magic, __ATOMIC_RELAXED) == PAYLOAD_MAGIC) {
+		do {
+			if (__seq_begin(&p->seq, &seq) == -1) {
+				len = 0;
+				break;
+			}
+			len = MIN(p->len, HEYNOTI_PAYLOAD_MAX);
+			memcpy(buf, p->data, len);
+		} while (__seq_retry(&p->seq, seq));
+	}
+
+	((heynoti_data_cb) t->cb) (len ? buf : NULL, len, t->cb_data);
+}
+
+/* keep the event until the window of t expires */
+static void __hold(struct noti_cont *nc, struct noti_slot *t,
+		   uint32_t mask, gint64 due)
+{
+	if (t->n_held++ == 0) {
+		g_atomic_int_inc(&t->ref);
+		g_ptr_array_add(nc->timers, t);
+	}
+
+	t->held_mask |= mask;
+	t->due = due;
+
+	if (nc->armed == 0 || due < nc->armed)
+		__arm_timer(nc);
+}
+
+static int __arm_timer(struct noti_cont *nc)
+{
+	struct itimerspec its;
+	struct noti_slot *t;
+	gint64 due;
+	guint i;
+
+	due = 0;
+	for (i = 0; i < nc->timers->len; i++) {
+		t = g_ptr_array_index(nc->timers, i);
+		if (due == 0 || t->due < due)
+			due = t->due;
+	}
+
+	/* an all-zero it_value disarms the timer */
+	memset(&its, 0, sizeof(its));
+	if (due) {
+		its.it_value.tv_sec = due / G_USEC_PER_SEC;
+		its.it_value.tv_nsec = (due % G_USEC_PER_SEC) * 1000;
+	}
+
+	nc->armed = due;
+
+	return timerfd_settime(nc->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* deliver every pending batch slot sharing the callback of slot i */
+static void __flush_batch(struct noti_cont *nc, guint i)
+{
+	struct noti_slot *t;
+	struct heynoti_event ev;
+	heynoti_batch_cb cb;
+	void *data;
+
+	t = g_ptr_array_index(nc->pending, i);
+	cb = (heynoti_batch_cb) t->cb;
+	data = t->cb_data;
+
+	g_array_set_size(nc->events, 0);
+	for (; i < nc->pending->len; i++) {
+		t = g_ptr_array_index(nc->pending, i);
+		if (t == NULL || !(t->flags & NS_BATCH))
+			continue;
+		if (t->cb != (void (*)(void *))cb || t->cb_data != data)
+			continue;
+
+		g_ptr_array_index(nc->pending, i) = NULL;
+		if (g_atomic_int_get(&t->dead)) {
+			t->n_pending = 0;
+			t->ev_mask = 0;
+			continue;
+		}
+
+		ev.noti = t->noti;
+		ev.mask = t->ev_mask;
+		ev.count = t->n_pending;
+		g_array_append_val(nc->events, ev);
+
+		t->n_pending = 0;
+		t->ev_mask = 0;
+	}
+
+	if (nc->events->len > 0)
+		cb((struct heynoti_event *)nc->events->data, nc->events->len,
+		   data);
+}
+
+static void __flush_pending(struct noti_cont *nc)
+{
+	struct noti_slot *t;
+	guint i;
+	int n;
+
+	/* callbacks may unsubscribe, which marks their slot dead */
+	for (i = 0; i < nc->pending->len; i++) {
+		t = g_ptr_array_index(nc->pending, i);
+		if (t == NULL)
+			continue;
+
+		if (nc->closing || g_atomic_int_get(&t->dead)) {
+			t->n_pending = 0;
+			t->ev_mask = 0;
+			continue;
+		}
+
+		if (t->flags & NS_BATCH) {
+			__flush_batch(nc, i);
+			continue;
+		}
+
+		n = t->n_pending;
+		t->n_pending = 0;
+		t->ev_mask = 0;
+		if (t->flags & NS_POOL)
+			__pool_push(nc, t, n);
+		else
+			((void (*)(void *, int))t->cb) (t->cb_data, n);
+	}
+
+	g_ptr_array_set_size(nc->pending, 0);
+}
+
+/* drops the one-shot slots delivered in this batch, publishing once */
+static void __flush_fired(struct noti_cont *nc)
+{
+	struct noti_slot *t;
+	struct noti_wd *w;
+	guint i;
+
+	if (nc->fired->len == 0 || nc->closing)
+		return;
+
+	g_mutex_lock(&nc->lock);
+	nc->deferring = 1;
+
+	for (i = 0; i < nc->fired->len; i++) {
+		t = g_ptr_array_index(nc->fired, i);
+
+		/* an unsubscribe from the callback may have beaten us */
+		w = __get_noti_wd(nc, t->wd);
+		if (w == NULL)
+			continue;
+
+		/* the kernel removed an IN_ONESHOT watch by itself */
+		if ((w->mask & IN_ONESHOT) && w->ns == t && w->n == 1)
+			__unlink_paths(nc, w);
+
+		if (__del_slots(nc, w, __match_slot, t) == -1)
+			UTIL_ERR("Error: del one-shot watch: %s",
+				 strerror(errno));
+	}
+
+	nc->deferring = 0;
+	__publish_dirty(nc);
+	g_mutex_unlock(&nc->lock);
+
+	g_ptr_array_set_size(nc->fired, 0);
+}
+
+/* the child of node i leading through c, made if missing */
+static int __pat_child(GArray *nodes, int i, int c)
+{
+	struct pat_node *p;
+	struct pat_node n;
+	int j;
+
+	for (j = g_array_index(nodes, struct pat_node, i).child; j != -1;
+	     j = g_array_index(nodes, struct pat_node, j).sibling) {
+		if (g_array_index(nodes, struct pat_node, j).c == c)
+			return j;
+	}
+
+	j = nodes->len;
+	p = &g_array_index(nodes, struct pat_node, i);
+	n.c = c;
+	n.child = -1;
+	n.sibling = p->child;
+	n.star = -1;
+	n.acc = NULL;
+	p->child = j;
+	if (c == PAT_STAR)
+		p->star = j;
+	g_array_append_val(nodes, n);
+
+	return j;
+}
+
+static struct pat_matcher *__pat_compile(GPtrArray *pats)
+{
+	struct pat_matcher *m;
+	struct pat_node root = { 0, -1, -1, -1, NULL };
+	struct pat_node *p;
+	struct noti_slot *t;
+	GArray *nodes;
+	const char *c;
+	guint i;
+	int j;
+
+	nodes = g_array_new(FALSE, FALSE, sizeof(struct pat_node));
+	g_array_append_val(nodes, root);
+
+	for (i = 0; i < pats->len; i++) {
+		t = g_ptr_array_index(pats, i);
+		j = 0;
+		for (c = t->noti; *c; c++) {
+			if (*c == '*' && c[1] == '*')
+				continue;
+			j = __pat_child(nodes, j, *c == '*' ? PAT_STAR :
+					*c == '?' ? PAT_ANY : (unsigned char)*c);
+		}
+
+		p = &g_array_index(nodes, struct pat_node, j);
+		if (p->acc == NULL)
+			p->acc = g_ptr_array_new();
+		g_ptr_array_add(p->acc, t);
+	}
+
+	m = g_malloc0(sizeof(struct pat_matcher));
+	m->n = nodes->len;
+	m->nodes = (struct pat_node *)g_array_free(nodes, FALSE);
+	m->cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					 (GDestroyNotify) g_ptr_array_unref);
+	m->mark = g_new0(unsigned int, m->n);
+	m->cur = g_array_new(FALSE, FALSE, sizeof(int));
+	m->next = g_array_new(FALSE, FALSE, sizeof(int));
+
+	return m;
+}
+
+static void __pat_free(struct pat_matcher *m)
+{
+	int i;
+
+	if (m == NULL)
+		return;
+
+	for (i = 0; i < m->n; i++) {
+		if (m->nodes[i].acc)
+			g_ptr_array_free(m->nodes[i].acc, TRUE);
+	}
+	g_free(m->nodes);
+	g_hash_table_destroy(m->cache);
+	g_free(m->mark);
+	g_array_free(m->cur, TRUE);
+	g_array_free(m->next, TRUE);
+	g_free(m);
+}
+
+static void __retire_pat(struct noti_cont *nc, void *p)
+{
+	__pat_free(p);
+}
+
+/* starts a new state set */
+static void __pat_new_set(struct pat_matcher *m, GArray *set)
+{
+	g_array_set_size(set, 0);
+	if (++m->gen == 0) {
+		memset(m->mark, 0, m->n * sizeof(unsigned int));
+		m->gen = 1;
+	}
+}
+
+/* adds node i to set, with the '*' nodes matching nothing after it */
+static void __pat_add_state(struct pat_matcher *m, GArray *set, int i)
+{
+	while (i != -1 && m->mark[i] != m->gen) {
+		m->mark[i] = m->gen;
+		g_array_append_val(set, i);
+		i = m->nodes[i].star;
+	}
+}
+
+/* the slots whose pattern matches name, owned by the cache */
+static GPtrArray *__pat_match(struct pat_matcher *m, const char *name)
+{
+	GPtrArray *r;
+	GArray *tmp;
+	struct pat_node *p;
+	const char *c;
+	guint i;
+	int j;
+
+	r = g_hash_table_lookup(m->cache, name);
+	if (r)
+		return r;
+
+	__pat_new_set(m, m->cur);
+	__pat_add_state(m, m->cur, 0);
+
+	for (c = name; *c && m->cur->len > 0; c++) {
+		__pat_new_set(m, m->next);
+
+		for (i = 0; i < m->cur->len; i++) {
+			p = &m->nodes[g_array_index(m->cur, int, i)];
+			if (p->c == PAT_STAR)
+				__pat_add_state(m, m->next,
+						g_array_index(m->cur, int, i));
+
+			for (j = p->child; j != -1; j = m->nodes[j].sibling) {
+				if (m->nodes[j].c == (unsigned char)*c ||
+				    m->nodes[j].c == PAT_ANY)
+					__pat_add_state(m, m->next, j);
+			}
+		}
+
+		tmp = m->cur;
+		m->cur = m->next;
+		m->next = tmp;
+	}
+
+	r = g_ptr_array_new();
+	for (i = 0; *c == '\0' && i < m->cur->len; i++) {
+		p = &m->nodes[g_array_index(m->cur, int, i)];
+		for (j = 0; p->acc && j < (int)p->acc->len; j++)
+			g_ptr_array_add(r, g_ptr_array_index(p->acc, j));
+	}
+
+	if (g_hash_table_size(m->cache) >= PAT_CACHE_MAX)
+		g_hash_table_remove_all(m->cache);
+	g_hash_table_insert(m->cache, g_strdup(name), r);
+
+	return r;
+}
+
+static void __handle_pattern(struct noti_cont *nc, uint32_t mask,
+			     const char *name)
+{
+	struct pat_matcher *m;
+	struct noti_slot *t;
+	GPtrArray *r;
+	guint i;
+
+	m = g_atomic_pointer_get(&nc->pat);
+	if (m == NULL || nc->closing)
+		return;
+
+	/* a nested dispatch from a callback may restart the cache */
+	r = g_ptr_array_ref(__pat_match(m, name));
+	for (i = 0; i < r->len; i++) {
+		t = g_ptr_array_index(r, i);
+		if (!(mask & t->mask) || g_atomic_int_get(&t->dead))
+			continue;
+		((heynoti_pattern_cb) t->cb) (name, t->cb_data);
+	}
+	g_ptr_array_unref(r);
+}
+
+/* an event of a noti_root watch, named after its noti */
+static void __handle_root(struct noti_cont *nc, struct inotify_event *ie)
+{
+	if (ie->len == 0 || (ie->mask & IN_ISDIR)) {
+		util_warn_if(ie->mask & IN_IGNORED, "noti root is gone: %s",
+			     noti_root);
+		return;
+	}
+	if (strncmp(ie->name, NOTI_META, strlen(NOTI_META)) == 0) {
+		if (strcmp(ie->name, NOTI_SHARD_MARKER) == 0)
+			__reshard_roots(nc);
+		return;
+	}
+
+	if (nc->dir_mode)
+		__handle_callback(nc, __dir_key(ie->name), ie->mask, ie->name);
+	__handle_pattern(nc, ie->mask, ie->name);
+}
+
+static gint __int_cmp(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static inline int __is_root(struct noti_roots *r, int wd)
+{
+	return r && wd != -1 &&
+	    bsearch(&wd, r->wd, r->n, sizeof(int), __int_cmp) != NULL;
+}
+
+/*
+ * Watches noti_root, and its shards in the sharded layout. Flat files
+ * not migrated yet are still seen through noti_root.
+ */
+static struct noti_roots *__watch_roots(struct noti_cont *nc)
+{
+	struct noti_roots *r;
+	char path[FILENAME_MAX];
+	int n;
+	int i;
+	int wd;
+
+	/* a migration by another process is not missed for long */
+	n = __sharded() || __lookup_sharded() ? 1 + NOTI_SHARDS : 1;
+	r = g_malloc(sizeof(struct noti_roots) + n * sizeof(int));
+	r->n = 0;
+
+	for (i = 0; i < n; i++) {
+		if (i == 0)
+			snprintf(path, sizeof(path), "%s", noti_root);
+		else
+			snprintf(path, sizeof(path), "%s/%02x", noti_root,
+				 i - 1);
+
+		wd = inotify_add_watch(nc->fd, path,
+				       ROOT_MASK | IN_ONLYDIR | IN_MASK_ADD);
+		if (wd == -1) {
+			UTIL_ERR("watch noti root: %s : %s", path,
+				 strerror(errno));
+			if (i == 0) {
+				g_free(r);
+				return NULL;
+			}
+			continue;
+		}
+		r->wd[r->n++] = wd;
+	}
+
+	qsort(r->wd, r->n, sizeof(int), __int_cmp);
+
+	return r;
+}
+
+static void __retire_roots(struct noti_cont *nc, void *p)
+{
+	g_free(p);
+}
+
+/*
+ * The marker of a migration was made in noti_root: keys are published
+ * in the shards from now on, so they are watched as well.
+ */
+static void __reshard_roots(struct noti_cont *nc)
+{
+	struct noti_roots *old;
+	struct noti_roots *r;
+
+	if (!__lookup_sharded())
+		return;
+
+	g_mutex_lock(&nc->lock);
+	old = nc->roots;
+	if (old && old->n < 1 + NOTI_SHARDS) {
+		r = __watch_roots(nc);
+		if (r) {
+			g_atomic_pointer_set(&nc->roots, r);
+			__retire(nc, old, __retire_roots);
+		}
+	}
+	g_mutex_unlock(&nc->lock);
+}
+
+/*
+ * With nc->lock held, after nc->pats changed: publishes a new matcher
+ * and keeps the noti_root watches while there are patterns. Directory
+ * mode has them already.
+ */
+static int __sync_patterns(struct noti_cont *nc)
+{
+	struct pat_matcher *old;
+	struct noti_roots *r;
+	int i;
+
+	if (nc->be->watch_all && nc->be->watch_all(nc, nc->pats->len > 0))
+		return -1;
+
+	if (nc->pats->len > 0 && nc->roots == NULL && !nc->be->named) {
+		r = __watch_roots(nc);
+		if (r == NULL)
+			return -1;
+		g_atomic_pointer_set(&nc->roots, r);
+	}
+
+	old = nc->pat;
+	g_atomic_pointer_set(&nc->pat, nc->pats->len > 0 ?
+			     __pat_compile(nc->pats) : NULL);
+	if (old)
+		__retire(nc, old, __retire_pat);
+
+	if (nc->pats->len == 0 && nc->roots && !nc->dir_mode) {
+		r = nc->roots;
+		g_atomic_pointer_set(&nc->roots, NULL);
+		for (i = 0; i < r->n; i++)
+			nc->be->unwatch(nc, r->wd[i]);
+		__retire(nc, r, __retire_roots);
+	}
+
+	return 0;
+}
+
+/* with nc->lock held, returns the number of pattern slots removed */
+static int __del_patterns(struct noti_cont *nc, slot_match_fn match,
+			  const void *key)
+{
+	struct noti_slot *t;
+	guint i;
+	int n_del;
+
+	n_del = 0;
+	for (i = 0; i < nc->pats->len;) {
+		t = g_ptr_array_index(nc->pats, i);
+		if (!match(t, key)) {
+			i++;
+			continue;
+		}
+
+		g_ptr_array_remove_index(nc->pats, i);
+		g_atomic_int_set(&t->dead, 1);
+		__retire(nc, t, __retire_slot);
+		n_del++;
+	}
+
+	if (n_del > 0)
+		__sync_patterns(nc);
+
+	return n_del;
+}
+
+static inline long __futex(uint32_t *uaddr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+static inline struct shm_slot *__shm_slots(struct shm_hdr *h)
+{
+	return (struct shm_slot *)(h + 1);
+}
+
+static struct shm_hdr *__shm_map(void)
+{
+	char path[FILENAME_MAX];
+	struct shm_hdr *h = MAP_FAILED;
+	struct stat sb;
+	size_t size;
+	int fd;
+
+	size = sizeof(struct shm_hdr) + SHM_SLOTS * sizeof(struct shm_slot);
+	snprintf(path, sizeof(path), "%s/%s", noti_root, SHM_FILE);
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (fd == -1 || flock(fd, LOCK_EX) == -1 || fstat(fd, &sb) == -1)
+		goto err;
+
+	if (sb.st_size == 0) {
+		/* publishers of any user ring it, regardless of the umask */
+		fchmod(fd, 0666);
+		if (ftruncate(fd, size) == -1)
+			goto err;
+	} else if (sb.st_size != (off_t)size) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (h == MAP_FAILED)
+		goto err;
+
+	if (h->magic == 0) {
+		h->n_slots = SHM_SLOTS;
+		h->magic = SHM_MAGIC;
+	} else if (h->magic != SHM_MAGIC || h->n_slots != SHM_SLOTS) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	flock(fd, LOCK_UN);
+	shm_fd = fd;
+
+	return h;
+
+ err:
+	UTIL_ERR("shm backend: %s : %s", path, strerror(errno));
+	if (h != MAP_FAILED)
+		munmap(h, size);
+	if (fd != -1)
+		close(fd);
+
+	return NULL;
+}
+
+/*
+ * The slot of name, added if create is set. Lookups take no lock:
+ * names are only added, each at the end of its probe sequence.
+ */
+static int __shm_key(struct shm_hdr *h, const char *name, int create)
+{
+	struct shm_slot *s = __shm_slots(h);
+	uint32_t mask = SHM_SLOTS - 1;
+	uint32_t hash;
+	uint32_t i;
+	uint32_t n;
+	int r;
+
+	if (strlen(name) > SHM_NAME_MAX) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	hash = __fnv1a(name);
+
+ again:
+	for (n = 0, i = hash & mask; n < SHM_SLOTS; n++, i = (i + 1) & mask) {
+		if (__atomic_load_n(&s[i].state, __ATOMIC_ACQUIRE) == SHM_EMPTY)
+			break;
+		if (s[i].hash == hash && strcmp(s[i].name, name) == 0)
+			return i;
+	}
+
+	if (!create) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (n == SHM_SLOTS) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	/* the flock does not keep out the threads of this process */
+	G_LOCK(shm);
+	flock(shm_fd, LOCK_EX);
+	r = -1;
+	if (__atomic_load_n(&s[i].state, __ATOMIC_ACQUIRE) == SHM_EMPTY) {
+		s[i].hash = hash;
+		memcpy(s[i].name, name, strlen(name) + 1);
+		__atomic_store_n(&s[i].state, SHM_USED, __ATOMIC_RELEASE);
+		r = i;
+	}
+	flock(shm_fd, LOCK_UN);
+	G_UNLOCK(shm);
+
+	/* taken meanwhile, maybe by name itself */
+	if (r == -1)
+		goto again;
+
+	return r;
+}
+
+static void __shm_ring(struct shm_hdr *h, int i)
+{
+	__atomic_add_fetch(&h->seq[i], 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&h->group[i >> SHM_GROUP_BITS], 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&h->bell, 1, __ATOMIC_SEQ_CST);
+
+	/* pairs with the waiter counting itself before it checks the bell */
+	if (__atomic_load_n(&h->waiters, __ATOMIC_SEQ_CST))
+		__futex(&h->bell, FUTEX_WAKE, INT_MAX);
+}
+
+static gpointer __shm_wait(gpointer data)
+{
+	struct noti_cont *nc = data;
+	struct shm_hdr *h = nc->shm;
+	uint64_t one = 1;
+	uint32_t bell = nc->shm_bell;
+	uint32_t cur;
+
+	while (!g_atomic_int_get(&nc->shm_stop)) {
+		__atomic_add_fetch(&h->waiters, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&h->bell, __ATOMIC_SEQ_CST) == bell)
+			__futex(&h->bell, FUTEX_WAIT, bell);
+		__atomic_sub_fetch(&h->waiters, 1, __ATOMIC_SEQ_CST);
+
+		cur = __atomic_load_n(&h->bell, __ATOMIC_SEQ_CST);
+		if (cur != bell) {
+			bell = cur;
+			if (write(nc->fd, &one, sizeof(one)) == -1 &&
+			    errno != EAGAIN)
+				UTIL_ERR("shm backend: wake : %s",
+					 strerror(errno));
+		}
+	}
+
+	return NULL;
+}
+
+static void __shm_stop(struct noti_cont *nc)
+{
+	g_atomic_int_set(&nc->shm_stop, 1);
+
+	/* other contexts wake for nothing, and scan nothing */
+	__atomic_add_fetch(&nc->shm->bell, 1, __ATOMIC_SEQ_CST);
+	__futex(&nc->shm->bell, FUTEX_WAKE, INT_MAX);
+
+	g_thread_join(nc->shm_thread);
+	nc->shm_thread = NULL;
+}
+
+/* counts of the slots, then of the groups, as of now */
+static void __shm_snapshot(struct noti_cont *nc)
+{
+	struct shm_hdr *h = nc->shm;
+	int i;
+
+	/* a publish in between moves its group again, at worst */
+	for (i = 0; i < SHM_GROUPS; i++)
+		nc->shm_seen[SHM_SLOTS + i] =
+		    __atomic_load_n(&h->group[i], __ATOMIC_ACQUIRE);
+	for (i = 0; i < SHM_SLOTS; i++)
+		nc->shm_seen[i] = __atomic_load_n(&h->seq[i], __ATOMIC_ACQUIRE);
+}
+
+/* dispatch of a shm context: the keys whose count moved fired */
+static int __handle_shm(struct noti_cont *nc)
+{
+	struct shm_hdr *h = nc->shm;
+	struct shm_slot *s = __shm_slots(h);
+	uint32_t *seen = nc->shm_seen;
+	uint32_t seq;
+	int g;
+	int i;
+
+	__enter_dispatch(nc);
+	nc->n_event = 0;
+
+	for (g = 0; g < SHM_GROUPS; g++) {
+		/* the group first: its slot moved before it did */
+		seq = __atomic_load_n(&h->group[g], __ATOMIC_ACQUIRE);
+		if (seq == seen[SHM_SLOTS + g])
+			continue;
+		seen[SHM_SLOTS + g] = seq;
+
+		for (i = g << SHM_GROUP_BITS;
+		     i < (g + 1) << SHM_GROUP_BITS; i++) {
+			seq = __atomic_load_n(&h->seq[i], __ATOMIC_ACQUIRE);
+			if (seq == __atomic_load_n(&seen[i], __ATOMIC_RELAXED))
+				continue;
+			__atomic_store_n(&seen[i], seq, __ATOMIC_RELAXED);
+
+			nc->n_event++;
+			__handle_callback(nc, i, IN_CLOSE_WRITE, NULL);
+			__handle_pattern(nc, IN_CLOSE_WRITE, s[i].name);
+		}
+	}
+
+	__flush_pending(nc);
+	__flush_fired(nc);
+	__leave_dispatch(nc);
+
+	return 0;
+}
+
+/* doubles the event buffer until avail bytes fit, up to EVENT_BUF_MAX */
+static int __grow_event_buf(struct noti_cont *nc, int avail)
+{
+	int size;
+	char *buf;
+
+	if (avail > EVENT_BUF_MAX)
+		avail = EVENT_BUF_MAX;
+
+	size = nc->buf_size;
+	while (size < avail)
+		size <<= 1;
+	if (size == nc->buf_size)
+		return size;
+
+	buf = realloc(nc->buf, size);
+	util_retvm_if(buf == NULL, nc->buf_size, "Error: grow event buffer");
+
+	nc->buf = buf;
+	nc->buf_size = size;
+
+	return size;
+}
+
+/* takes up the size heynoti_set_event_buffer() asked for */
+static void __set_event_buf(struct noti_cont *nc)
+{
+	int size;
+	char *buf;
+
+	size = g_atomic_int_get(&nc->buf_want);
+	if (size == -1 ||
+	    !g_atomic_int_compare_and_exchange(&nc->buf_want, size, -1))
+		return;
+
+	/* 0 returns to the default, FIONREAD sized buffer */
+	if (size == 0) {
+		nc->buf_fixed = 0;
+		return;
+	}
+
+	buf = realloc(nc->buf, size);
+	util_retm_if(buf == NULL, "Error: event buffer: %s", strerror(errno));
+
+	nc->buf = buf;
+	nc->buf_size = size;
+	nc->buf_fixed = 1;
+}
+
+static int __fill_event_buf(struct noti_cont *nc)
+{
+	int avail;
+
+	if (nc->buf_fixed)
+		return nc->buf_size;
+
+	/* size the next read from the pending queue length */
+	avail = 0;
+	if (ioctl(nc->fd, FIONREAD, &avail) == -1 || avail <= nc->buf_size)
+		return nc->buf_size;
+
+	return __grow_event_buf(nc, avail);
+}
+
+/*
+ * Reads and dispatches the events of an inotify fd with rd. Unless
+ * probe is set, the buffer grows after full reads instead of being
+ * sized from FIONREAD first. The buffer of nc is only resized, or
+ * read into, by the outermost dispatch: a callback reading again
+ * must not move or overwrite the events still being walked.
+ */
+static int __read_events(int fd, struct noti_cont *nc, read_fn rd, int probe)
+{
+	int r;
+	int own;
+	int size;
+	char *buf;
+	char *p;
+	char stack_buf[EVENT_BUF_MIN];
+	struct inotify_event *ie;
+
+	own = nc && nc->dispatching == 0;
+	if (own) {
+		__set_event_buf(nc);
+		size = probe ? __fill_event_buf(nc) : nc->buf_size;
+		buf = nc->buf;
+	} else {
+		size = sizeof(stack_buf);
+		buf = stack_buf;
+	}
+	if (nc)
+		__enter_dispatch(nc);
+
+	while ((r = rd(fd, buf, size)) > 0) {
+		if (nc)
+			nc->n_event = 0;
+
+		for (p = buf; p < buf + r;
+		     p += sizeof(struct inotify_event) + ie->len) {
+			ie = (struct inotify_event *)p;
+			if (nc == NULL)
+				continue;
+
+			nc->n_event++;
+			if (__is_root(g_atomic_pointer_get(&nc->roots), ie->wd))
+				__handle_root(nc, ie);
+			else if (ie->mask & IN_IGNORED)
+				__forget_wd(nc, ie->wd);
+			else
+				__handle_callback(nc, ie->wd, ie->mask, NULL);
+		}
+
+		/* a short read means the queue has been drained */
+		if (r < size - (int)EVENT_BUF_MIN)
+			break;
+
+		if (own && !probe && !nc->buf_fixed) {
+			size = __grow_event_buf(nc, size + 1);
+			buf = nc->buf;
+		}
+	}
+
+	if (nc) {
+		__flush_pending(nc);
+		__flush_fired(nc);
+		__leave_dispatch(nc);
+	}
+
+	return 0;
+}
+
+static int __inotify_drain(int fd, struct noti_cont *nc)
+{
+	return __read_events(fd, nc, read, 1);
+}
+
+static int __shm_drain(int fd, struct noti_cont *nc)
+{
+	uint64_t n;
+
+	if (read(fd, &n, sizeof(n)) == -1 && errno != EAGAIN)
+		return -1;
+
+	return nc ? __handle_shm(nc) : 0;
+}
+
+static int __handle_event(int fd)
+{
+	struct noti_cont *nc;
+
+	nc = __get_noti_cont(fd);
+	util_warn_if(nc == NULL, "Non-registered file descriptor");
+
+	if (nc == NULL)
+		return __inotify_drain(fd, NULL);
+
+	return nc->be->drain(fd, nc);
+}
+
+static int __handle_timer(int fd)
+{
+	uint64_t exp;
+	struct noti_cont *nc;
+	struct noti_slot *t;
+	GPtrArray *due;
+	gint64 now;
+	guint i;
+
+	nc = __get_noti_cont(fd);
+	util_retvm_if(nc == NULL, -1, "Non-registered file descriptor");
+
+	if (read(nc->tfd, &exp, sizeof(exp)) == -1 && errno != EAGAIN)
+		return -1;
+
+	__enter_dispatch(nc);
+
+	now = g_get_monotonic_time();
+	due = g_ptr_array_new();
+	for (i = 0; i < nc->timers->len;) {
+		t = g_ptr_array_index(nc->timers, i);
+		if (t->due > now) {
+			i++;
+			continue;
+		}
+		g_ptr_array_remove_index_fast(nc->timers, i);
+		g_ptr_array_add(due, t);
+	}
+
+	for (i = 0; i < due->len; i++) {
+		t = g_ptr_array_index(due, i);
+
+		if (!nc->closing && !g_atomic_int_get(&t->dead)) {
+			if (g_atomic_int_get(&t->flags) & NS_THROTTLE)
+				t->next_at = now + t->window * 1000LL;
+
+			__deliver(nc, t, t->held_mask, t->n_held);
+		}
+
+		t->n_held = 0;
+		t->held_mask = 0;
+		t->due = 0;
+
+		/* the subscription still holds t if it was delivered */
+		__slot_unref(nc, t);
+	}
+	g_ptr_array_free(due, TRUE);
+
+	__arm_timer(nc);
+	__flush_pending(nc);
+	__leave_dispatch(nc);
+
+	return 0;
+}
+
+API int heynoti_poll_event(int fd)
+{
+	int r;
+	int n;
+	struct noti_cont *nc;
+	struct pollfd fds[2];
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_ERR("Non-registered file descriptor : %d", fd);
+		errno = EBADF;
+		return -1;
+	}
+
+	if (nc->ht != H_NONE) {
+		UTIL_ERR("Another handler already in progress");
+		errno = EALREADY;
+		return -1;
+	}
+
+	fds[0].fd = nc->fd;
+	fds[0].events = POLLIN;
+	n = 1;
+
+	if (g_atomic_int_get(&nc->tfd) != -1) {
+		fds[1].fd = nc->tfd;
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+		n++;
+	}
+
+	r = poll(fds, n, -1);
+	util_retvm_if(r == -1, -1, "Error: poll : %s", strerror(errno));
+
+	if (fds[0].revents & POLLIN)
+		__handle_event(fd);
+
+	if (n > 1 && (fds[1].revents & POLLIN))
+		__handle_timer(fd);
+
+	return r;
+}
+
+static void __bind_path(struct noti_cont *nc, struct noti_wd *w,
+			const char *notipath)
+{
+	const char *path;
+
+	path = g_string_chunk_insert_const(nc->names, notipath);
+	g_hash_table_insert(nc->path_tbl, (gpointer) path, w);
+	if (w->n_path++ == 0)
+		w->path = path;
+}
+
+static gboolean __is_wd(gpointer key, gpointer val, gpointer data)
+{
+	return val == data;
+}
+
+/* the next subscribe through these paths makes a new watch */
+static void __unlink_paths(struct noti_cont *nc, struct noti_wd *w)
+{
+	if (w->n_path > 1)
+		g_hash_table_foreach_remove(nc->path_tbl, __is_wd, w);
+	else if (w->n_path == 1)
+		g_hash_table_remove(nc->path_tbl, w->path);
+	w->n_path = 0;
+}
+
+/* the kernel dropped the watch, the file is gone */
+static void __forget_wd(struct noti_cont *nc, int wd)
+{
+	struct noti_wd *w;
+
+	g_mutex_lock(&nc->lock);
+	w = __get_noti_wd(nc, wd);
+	if (w)
+		__unlink_paths(nc, w);
+	g_mutex_unlock(&nc->lock);
+}
+
+/*
+ * Brings the kernel mask of w to the union of its slot masks and mask.
+ * Returns the wd the path names now, which differs from w->wd if the
+ * file was replaced.
+ */
+static int __sync_wd(struct noti_cont *nc, struct noti_wd *w, uint32_t mask)
+{
+	int r;
+	uint32_t mask_all;
+	struct noti_slot *t;
+
+	mask_all = mask;
+	for (t = w->ns; t != NULL; t = t->next)
+		mask_all |= t->mask;
+
+	/* the directory watch covers every mask */
+	if (nc->dir_mode) {
+		w->mask = mask_all;
+		return w->wd;
+	}
+
+	if (mask_all == w->mask || w->n_path == 0)
+		return w->wd;
+
+	if ((mask_all & w->mask) == w->mask)
+		r = nc->be->watch(nc, NULL, w->path, mask_all | IN_MASK_ADD);
+	else
+		r = nc->be->watch(nc, NULL, w->path, mask_all);
+
+	if (r == w->wd)
+		w->mask = mask_all;
+
+	return r;
+}
+
+static int __add_slot(struct noti_cont *nc, const char *noti,
+		      const char *notipath, void (*cb) (void *), void *data,
+		      uint32_t mask, int flags)
+{
+	int wd;
+	int oneshot = 0;
+	struct noti_slot *n;
+	struct noti_slot *f;
+	struct noti_wd *w;
+
+	w = g_hash_table_lookup(nc->path_tbl, notipath);
+	if (w) {
+		wd = __sync_wd(nc, w, mask);
+		util_retvm_if(wd == -1, -1, "Error: add noti: %s",
+			      strerror(errno));
+
+		if (wd != w->wd) {
+			/* the file was replaced, its old watch is stale */
+			__unlink_paths(nc, w);
+			w = NULL;
+		}
+	} else {
+		/* events carry the name relative to noti_root only */
+		if (nc->dir_mode && strchr(noti, '/')) {
+			errno = EINVAL;
+			UTIL_ERR("Error: add noti: %s: not in %s", noti,
+				 noti_root);
+			return -1;
+		}
+
+		/* alone on a new watch, let the kernel drop it on delivery */
+		wd = -1;
+		if ((flags & NS_ONCE) && !nc->dir_mode) {
+			wd = nc->be->watch(nc, noti, notipath,
+					   mask | IN_ONESHOT | IN_MASK_CREATE);
+			oneshot = wd != -1;
+		}
+		if (wd == -1)
+			wd = nc->be->watch(nc, noti, notipath,
+					   mask | IN_MASK_ADD);
+		util_retvm_if(wd == -1, -1, "Error: add noti: %s",
+			      strerror(errno));
+	}
+
+	if (w == NULL) {
+		/* the path may be another name of a watched file */
+		w = __get_noti_wd(nc, wd);
+		if (w == NULL) {
+			w = __slab_alloc(&nc->wds);
+			if (w == NULL) {
+				nc->be->unwatch(nc, wd);
+				UTIL_ERR("Error: add noti: %s",
+					 strerror(errno));
+				return -1;
+			}
+			memset(w, 0, sizeof(struct noti_wd));
+			w->wd = wd;
+			if (oneshot)
+				w->mask = IN_ONESHOT;
+			g_hash_table_insert(nc->wd_tbl, GINT_TO_POINTER(wd), w);
+		} else if (oneshot) {
+			/* a kernel without IN_MASK_CREATE replaced the mask
+			 * of the watch another name made, restore it */
+			w->mask |= IN_ONESHOT;
+			__sync_wd(nc, w, mask);
+		}
+		w->mask |= mask;
+		__bind_path(nc, w, notipath);
+	}
+
+	/* id subscriptions may share a callback with different data */
+	for (f = w->ns; f != NULL && !(flags & NS_ID); f = f->next) {
+		if (f->cb == cb && __is_noti(nc, f, noti)) {
+			errno = EALREADY;
+			return -1;
+		}
+	}
+
+	n = __slot_new(nc);
+	if (n == NULL)
+		goto err;
+
+	n->noti = g_string_chunk_insert_const(nc->names, noti);
+	n->wd = wd;
+	n->cb_data = data;
+	n->cb = cb;
+	n->mask = mask;
+	n->flags = flags;
+	n->ref = 1;
+
+	if (w->last)
+		w->last->next = n;
+	else
+		w->ns = n;
+	w->last = n;
+	w->n++;
+
+	__publish(nc, wd);
+
+	return n->id;
+
+ err:
+	UTIL_ERR("Error: add noti: %s", strerror(errno));
+	if (w->ns == NULL) {
+		nc->be->unwatch(nc, wd);
+		__free_noti_wd(nc, w);
+	} else {
+		__sync_wd(nc, w, 0);
+	}
+	return -1;
+}
+
+static int __add_noti(int fd, const char *noti, const char *notipath,
+		      void (*cb) (void *), void *data, uint32_t mask, int flags)
+{
+	int r;
+	struct noti_cont *nc;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_DBG("Bad file descriptor");
+		errno = EBADF;
+		return -1;
+	}
+
+	g_mutex_lock(&nc->lock);
+	r = __add_slot(nc, noti, notipath, cb, data, mask, flags);
+	g_mutex_unlock(&nc->lock);
+
+	/* the subscription id, or -1 */
+	return r;
+}
+
+API int heynoti_subscribe(int fd, const char *noti, void (*cb) (void *),
+			  void *data)
+{
+	char notipath[FILENAME_MAX];
+
+	if (noti == NULL || cb == NULL) {
+		UTIL_DBG("Error: add noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	UTIL_DBG("add watch: [%s]", notipath);
+
+	return __add_noti(fd, noti, notipath, cb, data,
+			  IN_CLOSE_WRITE | IN_DELETE, 0) < 0 ? -1 : 0;
+}
+
+API int heynoti_subscribe_coalesce(int fd, const char *noti,
+				   void (*cb) (void *, int), void *data)
+{
+	char notipath[FILENAME_MAX];
+
+	if (noti == NULL || cb == NULL) {
+		UTIL_DBG("Error: add noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	UTIL_DBG("add coalesced watch: [%s]", notipath);
+
+	return __add_noti(fd, noti, notipath, (void (*)(void *))cb, data,
+			  IN_CLOSE_WRITE | IN_DELETE, NS_COALESCE) < 0 ? -1 : 0;
+}
+
+API int heynoti_subscribe_batch(int fd, const char *noti,
+				void (*cb) (const struct heynoti_event *, int,
+					    void *), void *data)
+{
+	char notipath[FILENAME_MAX];
+
+	if (noti == NULL || cb == NULL) {
+		UTIL_DBG("Error: add noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	UTIL_DBG("add batch watch: [%s]", notipath);
+
+	return __add_noti(fd, noti, notipath, (void (*)(void *))cb, data,
+			  IN_CLOSE_WRITE | IN_DELETE, NS_BATCH) < 0 ? -1 : 0;
+}
+
+API int heynoti_subscribe_id(int fd, const char *noti, void (*cb) (void *),
+			     void *data)
+{
+	char notipath[FILENAME_MAX];
+
+	if (noti == NULL || cb == NULL) {
+		UTIL_DBG("Error: add noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	UTIL_DBG("add watch by id: [%s]", notipath);
+
+	return __add_noti(fd, noti, notipath, cb, data,
+			  IN_CLOSE_WRITE | IN_DELETE, NS_ID);
+}
+
+API int heynoti_subscribe_once(int fd, const char *noti, void (*cb) (void *),
+			       void *data)
+{
+	char notipath[FILENAME_MAX];
+
+	if (noti == NULL || cb == NULL) {
+		UTIL_DBG("Error: add noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	UTIL_DBG("add one-shot watch: [%s]", notipath);
+
+	return __add_noti(fd, noti, notipath, cb, data,
+			  IN_CLOSE_WRITE | IN_DELETE, NS_ONCE) < 0 ? -1 : 0;
+}
+
+API int heynoti_subscribe_data(int fd, const char *noti,
+			       void (*cb) (const void *, int, void *),
+			       void *data)
+{
+	char notipath[FILENAME_MAX];
+
+	if (noti == NULL || cb == NULL) {
+		UTIL_DBG("Error: add noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	UTIL_DBG("add data watch: [%s]", notipath);
+
+	return __add_noti(fd, noti, notipath, (void (*)(void *))cb, data,
+			  IN_CLOSE_WRITE | IN_DELETE, NS_DATA) < 0 ? -1 : 0;
+}
+
+API int heynoti_subscribe_many(int fd, const char *const names[], int n,
+			       void (*cb) (void *), void *data, int *result)
+{
+	int i;
+	int r;
+	int n_ok;
+	char notipath[FILENAME_MAX];
+	struct noti_cont *nc;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_DBG("Bad file descriptor");
+		errno = EBADF;
+		return -1;
+	}
+
+	if (names == NULL || n < 0 || cb == NULL) {
+		UTIL_DBG("Error: add noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	n_ok = 0;
+
+	g_mutex_lock(&nc->lock);
+	nc->deferring = 1;
+
+	for (i = 0; i < n; i++) {
+		if (names[i] == NULL) {
+			errno = EINVAL;
+			r = -1;
+		} else {
+			__make_noti_path(notipath, sizeof(notipath), names[i]);
+			r = __add_slot(nc, names[i], notipath, cb, data,
+				       IN_CLOSE_WRITE | IN_DELETE, 0);
+		}
+
+		if (r >= 0)
+			n_ok++;
+		if (result)
+			result[i] = r >= 0 ? 0 : errno;
+	}
+
+	nc->deferring = 0;
+	__publish_dirty(nc);
+	g_mutex_unlock(&nc->lock);
+
+	UTIL_DBG("add %d of %d watches", n_ok, n);
+
+	return n_ok;
+}
+
+/*
+ * Removes the slots of w matching key, in one pass. Returns the number
+ * removed, or -1 if the watch could not be updated.
+ */
+static int __del_slots(struct noti_cont *nc, struct noti_wd *w,
+		       slot_match_fn match, const void *key)
+{
+	int r = 0;
+	int wd = w->wd;
+	struct noti_slot *t;
+	struct noti_slot **pt;
+	int n_del;
+	int n_remain;
+
+	n_del = 0;
+	n_remain = 0;
+
+	w->last = NULL;
+	pt = &w->ns;
+	while (*pt) {
+		t = *pt;
+		if (match(t, key)) {
+			*pt = t->next;
+			w->n--;
+			/* dispatch may still hold t, through a snapshot,
+			 * a pending list or a timer */
+			g_atomic_int_set(&t->dead, 1);
+			__retire(nc, t, __retire_slot);
+			n_del++;
+		} else {
+			w->last = t;
+			n_remain++;
+			pt = &t->next;
+		}
+	}
+
+	if (n_del == 0)
+		return 0;
+
+	if (n_remain == 0) {
+		/* a forgotten watch is already gone from the kernel */
+		if (w->n_path)
+			r = nc->be->unwatch(nc, wd);
+		/* so is a watch whose IN_ONESHOT event already came */
+		if (r == -1 && errno == EINVAL && (w->mask & IN_ONESHOT))
+			r = 0;
+		__free_noti_wd(nc, w);
+		__publish(nc, wd);
+		return r == -1 ? -1 : n_del;
+	}
+
+	r = __sync_wd(nc, w, 0);
+	if (r != -1 && r != wd) {
+		/* the file was replaced, do not keep a watch we never used */
+		__unlink_paths(nc, w);
+		if (__get_noti_wd(nc, r) == NULL)
+			nc->be->unwatch(nc, r);
+	}
+	__publish(nc, wd);
+
+	return r == -1 ? -1 : n_del;
+}
+
+static int __match_cb(struct noti_slot *t, const void *key)
+{
+	const struct slot_key *k = key;
+
+	return (k->cb == NULL || k->cb == t->cb) &&
+	    (k->noti == NULL || strcmp(t->noti, k->noti) == 0);
+}
+
+static int __match_cb_data(struct noti_slot *t, const void *key)
+{
+	const struct slot_key *k = key;
+
+	return (k->cb == NULL || k->cb == t->cb) && k->data == t->cb_data;
+}
+
+/* the text of a glob says nothing of the names it matches */
+static int __match_prefix(struct noti_slot *t, const void *key)
+{
+	const struct slot_key *k = key;
+
+	return !(t->flags & NS_PATTERN) &&
+	    strncmp(t->noti, k->prefix, k->len) == 0;
+}
+
+static int __match_slot(struct noti_slot *t, const void *key)
+{
+	return t == key;
+}
+
+static int _del_noti(struct noti_cont *nc, struct noti_wd *w,
+		     const char *noti, void (*cb) (void *))
+{
+	int r;
+	struct slot_key k = { .cb = cb };
+
+	if (nc->dir_mode)
+		k.noti = noti;
+
+	r = __del_slots(nc, w, __match_cb, &k);
+	if (r == 0) {
+		UTIL_DBG("Error: nothing deleted");
+		errno = ENOENT;
+		return -1;
+	}
+
+	return r == -1 ? -1 : 0;
+}
+
+/* removes the matching slots of every watch, publishing once */
+static int __del_matching(int fd, slot_match_fn match,
+			  const struct slot_key *k)
+{
+	int r;
+	int n_del;
+	struct noti_cont *nc;
+	GPtrArray *ws;
+	GHashTableIter iter;
+	gpointer w;
+	guint i;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_DBG("Bad file descriptor");
+		errno = EBADF;
+		return -1;
+	}
+
+	g_mutex_lock(&nc->lock);
+	nc->deferring = 1;
+
+	/* __del_slots may drop w from wd_tbl */
+	ws = g_ptr_array_sized_new(g_hash_table_size(nc->wd_tbl));
+	g_hash_table_iter_init(&iter, nc->wd_tbl);
+	while (g_hash_table_iter_next(&iter, NULL, &w))
+		g_ptr_array_add(ws, w);
+
+	n_del = 0;
+	for (i = 0; i < ws->len; i++) {
+		r = __del_slots(nc, g_ptr_array_index(ws, i), match, k);
+		util_warn_if(r == -1, "Error: del watch: %s", strerror(errno));
+		if (r > 0)
+			n_del += r;
+	}
+	g_ptr_array_free(ws, TRUE);
+
+	n_del += __del_patterns(nc, match, k);
+
+	nc->deferring = 0;
+	__publish_dirty(nc);
+	g_mutex_unlock(&nc->lock);
+
+	return n_del;
+}
+
+static int del_noti(int fd, const char *noti, const char *notipath,
+		    void (*cb) (void *))
+{
+	int r;
+	struct noti_cont *nc;
+	struct noti_wd *w;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_DBG("Bad file descriptor");
+		errno = EBADF;
+		return -1;
+	}
+
+	g_mutex_lock(&nc->lock);
+
+	w = g_hash_table_lookup(nc->path_tbl, notipath);
+	if (w) {
+		r = _del_noti(nc, w, noti, cb);
+	} else {
+		errno = ENOENT;
+		r = -1;
+	}
+
+	g_mutex_unlock(&nc->lock);
+
+	return r;
+}
+
+/* with nc->lock held */
+static struct noti_slot *__find_slot(struct noti_cont *nc, const char *noti,
+				     const char *notipath,
+				     void (*cb) (void *))
+{
+	struct noti_wd *w;
+	struct noti_slot *t;
+
+	w = g_hash_table_lookup(nc->path_tbl, notipath);
+	if (w == NULL) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	for (t = w->ns; t != NULL; t = t->next) {
+		if (t->cb == cb && __is_noti(nc, t, noti))
+			return t;
+	}
+
+	errno = ENOENT;
+	return NULL;
+}
+
+API int heynoti_unsubscribe(int fd, const char *noti, void (*cb) (void *))
+{
+	int r;
+	char notipath[FILENAME_MAX];
+
+	if (fd < 0 || noti == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	UTIL_DBG("del watch: [%s]", notipath);
+
+	r = del_noti(fd, noti, notipath, cb);
+	util_warn_if(r == -1, "Error: del [%s]: %s", noti, strerror(errno));
+
+	return r;
+}
+
+API int heynoti_unsubscribe_id(int fd, int id)
+{
+	int r;
+	struct noti_cont *nc;
+	struct noti_slot *t;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_DBG("Bad file descriptor");
+		errno = EBADF;
+		return -1;
+	}
+
+	g_mutex_lock(&nc->lock);
+
+	/* pattern slots have no watch and no id handed out */
+	t = __slot_by_id(nc, id);
+	if (t && !(t->flags & NS_PATTERN)) {
+		r = __del_slots(nc, __get_noti_wd(nc, t->wd), __match_slot, t);
+	} else {
+		errno = ENOENT;
+		r = -1;
+	}
+
+	g_mutex_unlock(&nc->lock);
+
+	return r == -1 ? -1 : 0;
+}
+
+API int heynoti_unsubscribe_all(int fd, void (*cb) (void *), void *data)
+{
+	struct slot_key k = { .cb = cb, .data = data };
+
+	return __del_matching(fd, __match_cb_data, &k);
+}
+
+API int heynoti_unsubscribe_prefix(int fd, const char *prefix)
+{
+	struct slot_key k;
+
+	if (prefix == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	k.prefix = prefix;
+	k.len = strlen(prefix);
+
+	return __del_matching(fd, __match_prefix, &k);
+}
+
+API int heynoti_subscribe_pattern(int fd, const char *pattern,
+				  void (*cb) (const char *, void *), void *data)
+{
+	struct noti_cont *nc;
+	struct noti_slot *t;
+	guint i;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_DBG("Bad file descriptor");
+		errno = EBADF;
+		return -1;
+	}
+
+	/* events name the notis directly in noti_root only */
+	if (pattern == NULL || *pattern == '\0' || strchr(pattern, '/') ||
+	    cb == NULL) {
+		UTIL_DBG("Error: add pattern: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	UTIL_DBG("add pattern: [%s]", pattern);
+
+	g_mutex_lock(&nc->lock);
+
+	for (i = 0; i < nc->pats->len; i++) {
+		t = g_ptr_array_index(nc->pats, i);
+		if (t->cb == (void (*)(void *))cb &&
+		    strcmp(t->noti, pattern) == 0) {
+			errno = EALREADY;
+			goto err;
+		}
+	}
+
+	t = __slot_new(nc);
+	if (t == NULL)
+		goto err;
+
+	t->noti = g_string_chunk_insert_const(nc->names, pattern);
+	t->wd = -1;
+	t->cb_data = data;
+	t->cb = (void (*)(void *))cb;
+	t->mask = IN_CLOSE_WRITE | IN_DELETE;
+	t->flags = NS_PATTERN;
+	t->ref = 1;
+
+	g_ptr_array_add(nc->pats, t);
+	if (__sync_patterns(nc) == -1) {
+		g_ptr_array_remove_index(nc->pats, nc->pats->len - 1);
+		__slot_unref(nc, t);
+		goto err;
+	}
+
+	g_mutex_unlock(&nc->lock);
+
+	return 0;
+
+ err:
+	UTIL_ERR("Error: add pattern [%s]: %s", pattern, strerror(errno));
+	g_mutex_unlock(&nc->lock);
+	return -1;
+}
+
+API int heynoti_unsubscribe_pattern(int fd, const char *pattern,
+				    void (*cb) (const char *, void *))
+{
+	int r;
+	struct noti_cont *nc;
+	struct slot_key k = { .cb = (void (*)(void *))cb, .noti = pattern };
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_DBG("Bad file descriptor");
+		errno = EBADF;
+		return -1;
+	}
+
+	if (pattern == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	g_mutex_lock(&nc->lock);
+	r = __del_patterns(nc, __match_cb, &k);
+	g_mutex_unlock(&nc->lock);
+
+	if (r == 0) {
+		UTIL_DBG("Error: del pattern [%s]: nothing deleted", pattern);
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* opens the key file of noti, a name or a path, in either layout */
+static int __open_noti(const char *noti, int flags, char *notipath, int size)
+{
+	char altpath[FILENAME_MAX];
+	int fd;
+
+	if (strchr(noti, '/'))
+		snprintf(notipath, size, "%s", noti);
+	else
+		__make_noti_path(notipath, size, noti);
+	UTIL_DBG("send noti: [%s]", notipath);
+
+	fd = open(notipath, flags);
+	if (fd == -1 && errno == ENOENT) {
+		if (__alt_noti_path(altpath, sizeof(altpath), notipath) == 0)
+			fd = open(altpath, flags);
+		else
+			errno = ENOENT;
+	}
+
+	return fd;
+}
+
+/* noti_root, opened once, -1 if it cannot be */
+static int __root_fd(void)
+{
+	int fd;
+
+	fd = g_atomic_int_get(&root_fd);
+	if (fd != -1)
+		return fd;
+
+	fd = open(noti_root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (!g_atomic_int_compare_and_exchange(&root_fd, -1, fd)) {
+		close(fd);
+		fd = g_atomic_int_get(&root_fd);
+	}
+
+	return fd;
+}
+
+/*
+ * The relative path of noti from the fd __root_fd() returns, or noti
+ * itself from AT_FDCWD if it is a path. -1 if there is none.
+ */
+static int __batch_path(const char *noti, char *path, int size, int *dirfd)
+{
+	if (strchr(noti, '/')) {
+		*dirfd = AT_FDCWD;
+		return snprintf(path, size, "%s", noti) < size ? 0 : -1;
+	}
+
+	*dirfd = __root_fd();
+	if (*dirfd == -1)
+		return -1;
+
+	return __rel_noti_path(path, size, noti) < size ? 0 : -1;
+}
+
+static int __inotify_init(struct noti_cont *nc)
+{
+	int fd;
+
+	if (__get_kern_ver() < KERNEL_VERSION(2, 6, 13)) {
+		UTIL_ERR("inotify requires kernel version >= 2.6.13 ");
+		errno = EPERM;
+		return -1;
+	}
+
+	fd = inotify_init();
+	util_retvm_if(fd == -1, -1, "inotify init: %s", strerror(errno));
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	if (nc->dir_mode) {
+		nc->fd = fd;
+		nc->roots = __watch_roots(nc);
+		if (nc->roots == NULL) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+static void __inotify_fini(struct noti_cont *nc)
+{
+}
+
+static int __inotify_watch(struct noti_cont *nc, const char *noti,
+			   const char *notipath, uint32_t mask)
+{
+	/* the noti_root watches see every key */
+	if (nc->dir_mode)
+		return __dir_key(noti);
+
+	return __add_watch(nc->fd, notipath, mask);
+}
+
+static int __inotify_unwatch(struct noti_cont *nc, int wd)
+{
+	if (nc->dir_mode)
+		return 0;
+
+	return inotify_rm_watch(nc->fd, wd);
+}
+
+static int __inotify_publish(const char *noti)
+{
+	int fd;
+	char notipath[FILENAME_MAX];
+	struct stat sb;
+
+	fd = __open_noti(noti, O_TRUNC | O_WRONLY | O_CLOEXEC, notipath,
+			 sizeof(notipath));
+	if (fd == -1)
+		return -1;
+
+	/*
+	fstat(fd, &sb);
+	if(sb.st_uid != getuid())
+		fchown(fd, getuid(), getgid());
+	if(sb.st_mode & 0033)
+		fchmod(fd, 0644);
+	*/
+
+	close(fd);
+	return 0;
+}
+
+/* no lookup of noti_root a key, and no logging */
+static void __inotify_publish_many(const char *const *names, int n, int *err)
+{
+	char path[FILENAME_MAX];
+	int dirfd;
+	int fd;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		fd = -1;
+		if (__batch_path(names[i], path, sizeof(path), &dirfd) == 0)
+			fd = openat(dirfd, path,
+				    O_TRUNC | O_WRONLY | O_CLOEXEC);
+		if (fd != -1) {
+			close(fd);
+			err[i] = 0;
+			continue;
+		}
+
+		/* the other layout, and errno, are found the plain way */
+		err[i] = __inotify_publish(names[i]) == -1 ? errno : 0;
+	}
+}
+
+/*
+ * Whether publishes of the other backends open the key file too, for
+ * inotify subscribers: HEYNOTI_KEY_FILES=1 in the environment.
+ */
+static int __touch_keys(void)
+{
+	static int touch = -1;
+	const char *s;
+
+	if (g_atomic_int_get(&touch) == -1) {
+		s = getenv("HEYNOTI_KEY_FILES");
+		g_atomic_int_set(&touch, s && strcmp(s, "1") == 0);
+	}
+
+	return g_atomic_int_get(&touch);
+}
+
+/* a key is registered, else has a noti file in either layout */
+static int __key_exists(const char *noti)
+{
+	char notipath[FILENAME_MAX];
+	char altpath[FILENAME_MAX];
+
+	if (__reg_has(noti))
+		return 0;
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+	if (access(notipath, F_OK) == 0)
+		return 0;
+	if (errno != ENOENT)
+		return -1;
+	if (__alt_noti_path(altpath, sizeof(altpath), notipath) == 0)
+		return access(altpath, F_OK);
+
+	errno = ENOENT;
+	return -1;
+}
+
+/*
+ * The key file of a publish by another backend, only when asked for.
+ * A path has no other carrier than its file.
+ */
+static int __publish_key(const char *noti)
+{
+	if (__touch_keys() || strchr(noti, '/'))
+		return __inotify_publish(noti);
+
+	return __key_exists(noti);
+}
+
+static int __shm_setup(void)
+{
+	G_LOCK(shm);
+	if (shm == NULL)
+		g_atomic_pointer_set(&shm, __shm_map());
+	G_UNLOCK(shm);
+
+	return shm ? 0 : -1;
+}
+
+/* made readable by the bell thread instead of the kernel */
+static int __shm_init(struct noti_cont *nc)
+{
+	int fd;
+
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	util_retvm_if(fd == -1, -1, "eventfd: %s", strerror(errno));
+
+	nc->fd = fd;
+	nc->shm = shm;
+	/* publishes after the counts are read move the bell */
+	nc->shm_bell = __atomic_load_n(&shm->bell, __ATOMIC_SEQ_CST);
+	nc->shm_seen = g_new(uint32_t, SHM_SLOTS + SHM_GROUPS);
+	__shm_snapshot(nc);
+	nc->shm_thread = g_thread_new("heynoti-shm", __shm_wait, nc);
+
+	return fd;
+}
+
+static void __shm_fini(struct noti_cont *nc)
+{
+	if (nc->shm_thread)
+		__shm_stop(nc);
+	g_free(nc->shm_seen);
+}
+
+static int __shm_watch(struct noti_cont *nc, const char *noti,
+		       const char *notipath, uint32_t mask)
+{
+	int wd;
+
+	wd = __shm_key(nc->shm, noti, 1);
+	if (wd == -1)
+		return -1;
+
+	/* publishes before now are not delivered */
+	__atomic_store_n(&nc->shm_seen[wd],
+			 __atomic_load_n(&nc->shm->seq[wd], __ATOMIC_ACQUIRE),
+			 __ATOMIC_RELAXED);
+
+	return wd;
+}
+
+static int __shm_unwatch(struct noti_cont *nc, int wd)
+{
+	/* slots are never freed */
+	return 0;
+}
+
+/* a missing key fails as with inotify */
+static int __shm_publish(const char *noti)
+{
+	int i;
+
+	if (__publish_key(noti) == -1)
+		return -1;
+	if (strchr(noti, '/'))
+		return 0;
+
+	/* pattern subscribers look at every slot that moves */
+	i = __shm_key(shm, noti, 1);
+	if (i == -1) {
+		/* a full table: no shm context can watch the key either */
+		UTIL_DBG("shm backend: %s : %s", noti, strerror(errno));
+		return 0;
+	}
+
+	__shm_ring(shm, i);
+	return 0;
+}
+
+static int __broker_addr(struct sockaddr_un *sa)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	if (snprintf(sa->sun_path, sizeof(sa->sun_path), "%s/%s", noti_root,
+		     BROKER_SOCK) >= (int)sizeof(sa->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * A datagram socket talking to heynotid only. Contexts bind it to an
+ * abstract address of their own, the broker sends events there.
+ */
+static int __broker_connect(int flags, int bind_any)
+{
+	struct sockaddr_un sa;
+	sa_family_t any = AF_UNIX;
+	int fd;
+
+	if (__broker_addr(&sa) == -1)
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | flags, 0);
+	if (fd == -1)
+		return -1;
+
+	if ((bind_any && bind(fd, (struct sockaddr *)&any, sizeof(any)) == -1)
+	    || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+		UTIL_ERR("broker: %s : %s", sa.sun_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* fills m, returns its length */
+static int __broker_msg(struct broker_msg *m, int op, int key,
+			const char *name)
+{
+	size_t len;
+
+	m->op = op;
+	m->key = key;
+	len = BROKER_MSG_MIN;
+	if (name) {
+		if (strlen(name) > BROKER_NAME_MAX) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		strcpy(m->name, name);
+		len += strlen(name) + 1;
+	}
+
+	return len;
+}
+
+/* heynotid is not running, or was restarted since the connect */
+static inline int __broker_gone(int err)
+{
+	return err == ECONNREFUSED || err == ENOTCONN || err == EPIPE ||
+	    err == ENOENT;
+}
+
+/* connects fd again, to the socket of a restarted heynotid */
+static int __broker_reconnect(int fd)
+{
+	struct sockaddr_un sa;
+
+	if (__broker_addr(&sa) == -1)
+		return -1;
+
+	return connect(fd, (struct sockaddr *)&sa, sizeof(sa));
+}
+
+static int __broker_send(int fd, int op, int key, const char *name)
+{
+	struct broker_msg m;
+	int len;
+
+	len = __broker_msg(&m, op, key, name);
+	if (len == -1)
+		return -1;
+
+	/* a stalled broker fails publishers rather than blocking them */
+	return send(fd, &m, len, MSG_DONTWAIT | MSG_NOSIGNAL) == -1 ? -1 : 0;
+}
+
+/* the daemon is up if its socket takes a connection */
+static int __broker_setup(void)
+{
+	int fd;
+
+	if (g_atomic_int_get(&broker_fd) != -1)
+		return 0;
+
+	fd = __broker_connect(0, 0);
+	if (fd == -1)
+		return -1;
+	g_atomic_int_set(&broker_fd, fd);
+
+	return 0;
+}
+
+/*
+ * The fd of a context polls its socket, and an inotify watch of
+ * noti_root: heynotid renames its socket in place when it starts, and
+ * the subscriptions of the context are then sent again.
+ */
+static int __broker_init(struct noti_cont *nc)
+{
+	struct epoll_event ev;
+	int err;
+	int fd;
+
+	nc->bk_sock = __broker_connect(SOCK_NONBLOCK, 1);
+	nc->bk_ino = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	fd = epoll_create1(EPOLL_CLOEXEC);
+	if (nc->bk_sock == -1 || nc->bk_ino == -1 || fd == -1 ||
+	    inotify_add_watch(nc->bk_ino, noti_root,
+			      IN_MOVED_TO | IN_ONLYDIR) == -1)
+		goto err;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	if (epoll_ctl(fd, EPOLL_CTL_ADD, nc->bk_sock, &ev) == -1 ||
+	    epoll_ctl(fd, EPOLL_CTL_ADD, nc->bk_ino, &ev) == -1)
+		goto err;
+
+	return fd;
+
+ err:
+	err = errno;
+	UTIL_ERR("broker: context: %s", strerror(err));
+	if (fd != -1)
+		close(fd);
+	if (nc->bk_ino != -1)
+		close(nc->bk_ino);
+	if (nc->bk_sock != -1)
+		close(nc->bk_sock);
+	errno = err;
+
+	return -1;
+}
+
+static void __broker_fini(struct noti_cont *nc)
+{
+	__broker_send(nc->bk_sock, BROKER_BYE, 0, NULL);
+	close(nc->bk_ino);
+	close(nc->bk_sock);
+}
+
+/* a change made while heynotid is down is sent when it is back */
+static int __broker_ctl(struct noti_cont *nc, int op, int key)
+{
+	if (__broker_send(nc->bk_sock, op, key, NULL) == -1 &&
+	    !__broker_gone(errno))
+		return -1;
+
+	return 0;
+}
+
+static int __broker_watch(struct noti_cont *nc, const char *noti,
+			  const char *notipath, uint32_t mask)
+{
+	int wd = __dir_key(noti);
+
+	return __broker_ctl(nc, BROKER_SUB, wd) == -1 ? -1 : wd;
+}
+
+static int __broker_unwatch(struct noti_cont *nc, int wd)
+{
+	return __broker_ctl(nc, BROKER_UNSUB, wd);
+}
+
+static int __broker_watch_all(struct noti_cont *nc, int on)
+{
+	return __broker_ctl(nc, on ? BROKER_SUB_ALL : BROKER_UNSUB_ALL, 0);
+}
+
+/* whether heynotid put its socket in place since the last look */
+static int __broker_restarted(struct noti_cont *nc)
+{
+	char buf[EVENT_BUF_MIN * 4];
+	struct inotify_event *ie;
+	ssize_t r;
+	char *p;
+	int found;
+
+	found = 0;
+	while ((r = read(nc->bk_ino, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + r;
+		     p += sizeof(struct inotify_event) + ie->len) {
+			ie = (struct inotify_event *)p;
+			if (ie->len && strcmp(ie->name, BROKER_SOCK) == 0)
+				found = 1;
+		}
+	}
+
+	return found;
+}
+
+/* the keys of nc, and its patterns, to a restarted heynotid */
+static void __broker_resubscribe(struct noti_cont *nc)
+{
+	GHashTableIter iter;
+	gpointer wd;
+
+	if (__broker_reconnect(nc->bk_sock) == -1) {
+		UTIL_ERR("broker: reconnect: %s", strerror(errno));
+		return;
+	}
+
+	g_mutex_lock(&nc->lock);
+	g_hash_table_iter_init(&iter, nc->wd_tbl);
+	while (g_hash_table_iter_next(&iter, &wd, NULL))
+		__broker_send(nc->bk_sock, BROKER_SUB, GPOINTER_TO_INT(wd),
+			      NULL);
+	if (nc->pats->len > 0)
+		__broker_send(nc->bk_sock, BROKER_SUB_ALL, 0, NULL);
+	g_mutex_unlock(&nc->lock);
+}
+
+/*
+ * A missing key fails as with inotify. Without heynotid the publish
+ * reaches the subscribers of the key file only, if it was opened.
+ */
+static int __broker_publish(const char *noti)
+{
+	int key;
+
+	if (__publish_key(noti) == -1)
+		return -1;
+	if (strchr(noti, '/'))
+		return 0;
+
+	key = __dir_key(noti);
+	if (__broker_send(broker_fd, BROKER_PUB, key, noti) == 0)
+		return 0;
+	if (!__broker_gone(errno))
+		return -1;
+
+	if (__broker_reconnect(broker_fd) == 0 &&
+	    __broker_send(broker_fd, BROKER_PUB, key, noti) == 0)
+		return 0;
+
+	UTIL_DBG("broker: publish %s : %s", noti, strerror(errno));
+	return 0;
+}
+
+#define BROKER_BATCH	32
+
+/* the keys, then the datagrams of up to BROKER_BATCH keys a call */
+static void __broker_publish_many(const char *const *names, int n, int *err)
+{
+	struct broker_msg m[BROKER_BATCH];
+	struct iovec iov[BROKER_BATCH];
+	struct mmsghdr hdr[BROKER_BATCH];
+	int key[BROKER_BATCH];	/* of each datagram */
+	int retried;
+	int len;
+	int cnt;
+	int done;
+	int r;
+	int i;
+
+	if (__touch_keys()) {
+		__inotify_publish_many(names, n, err);
+	} else {
+		for (i = 0; i < n; i++)
+			err[i] = __publish_key(names[i]) == -1 ? errno : 0;
+	}
+
+	for (i = 0; i < n;) {
+		for (cnt = 0; cnt < BROKER_BATCH && i < n; i++) {
+			if (err[i] != 0 || strchr(names[i], '/'))
+				continue;
+
+			len = __broker_msg(&m[cnt], BROKER_PUB,
+					   __dir_key(names[i]), names[i]);
+			if (len == -1) {
+				err[i] = errno;
+				continue;
+			}
+
+			iov[cnt].iov_base = &m[cnt];
+			iov[cnt].iov_len = len;
+			memset(&hdr[cnt], 0, sizeof(struct mmsghdr));
+			hdr[cnt].msg_hdr.msg_iov = &iov[cnt];
+			hdr[cnt].msg_hdr.msg_iovlen = 1;
+			key[cnt++] = i;
+		}
+
+		/* one that fails is not sent, the rest are tried again */
+		retried = 0;
+		for (done = 0; done < cnt;) {
+			r = sendmmsg(broker_fd, hdr + done, cnt - done,
+				     MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (r > 0) {
+				done += r;
+				continue;
+			}
+			if (r == -1 && __broker_gone(errno)) {
+				if (!retried++ &&
+				    __broker_reconnect(broker_fd) == 0)
+					continue;
+				/* as __broker_publish() without heynotid */
+				break;
+			}
+			err[key[done++]] = r == 0 ? EAGAIN : errno;
+		}
+	}
+}
+
+static int __broker_drain(int fd, struct noti_cont *nc)
+{
+	struct broker_msg m;
+	ssize_t r;
+
+	/* the sockets of fd went with its context */
+	if (nc == NULL)
+		return 0;
+
+	if (__broker_restarted(nc))
+		__broker_resubscribe(nc);
+
+	__enter_dispatch(nc);
+	nc->n_event = 0;
+
+	while ((r = recv(nc->bk_sock, &m, sizeof(m), MSG_DONTWAIT)) > 0) {
+		if (m.op != BROKER_PUB || r <= (ssize_t)BROKER_MSG_MIN)
+			continue;
+		m.name[r - BROKER_MSG_MIN - 1] = '\0';
+
+		nc->n_event++;
+		__handle_callback(nc, __dir_key(m.name), IN_CLOSE_WRITE,
+				  m.name);
+		__handle_pattern(nc, IN_CLOSE_WRITE, m.name);
+	}
+
+	__flush_pending(nc);
+	__flush_fired(nc);
+	__leave_dispatch(nc);
+
+	return r == -1 && errno != EAGAIN ? -1 : 0;
+}
+
+#ifdef HAVE_IO_URING
+static void __uring_unmap(struct uring *u)
+{
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_size);
+	if (u->ring)
+		munmap(u->ring, u->ring_size);
+	if (u->fd != -1)
+		close(u->fd);
+
+	memset(u, 0, sizeof(struct uring));
+	u->fd = -1;
+}
+
+static int __uring_map(struct uring *u)
+{
+	struct io_uring_params p;
+	struct io_uring_probe *probe = NULL;
+	static const int ops[] = {
+		IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_READ
+	};
+	size_t sq_size;
+	size_t cq_size;
+	char *ring;
+	int slots[URING_SLOTS];
+	int err;
+	int i;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (u->fd == -1)
+		goto err;
+
+	/* the rings share a mapping from 5.4 on */
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		errno = ENOSYS;
+		goto err;
+	}
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->ring_size = MAX(sq_size, cq_size);
+	ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		goto err;
+	u->ring = ring;
+
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		goto err;
+	}
+
+	u->sq_head = (unsigned int *)(ring + p.sq_off.head);
+	u->sq_tail = (unsigned int *)(ring + p.sq_off.tail);
+	u->sq_mask = (unsigned int *)(ring + p.sq_off.ring_mask);
+	u->sq_array = (unsigned int *)(ring + p.sq_off.array);
+	u->cq_head = (unsigned int *)(ring + p.cq_off.head);
+	u->cq_tail = (unsigned int *)(ring + p.cq_off.tail);
+	u->cq_mask = (unsigned int *)(ring + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+	/* empty slots for the direct descriptors of publishes */
+	for (i = 0; i < URING_SLOTS; i++)
+		slots[i] = -1;
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_FILES,
+		    slots, URING_SLOTS) == -1)
+		goto err;
+
+	probe = g_malloc0(sizeof(struct io_uring_probe) +
+			  256 * sizeof(struct io_uring_probe_op));
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PROBE,
+		    probe, 256) == -1)
+		goto err;
+	for (i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+		if (probe->last_op < ops[i] ||
+		    !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			errno = EOPNOTSUPP;
+			goto err;
+		}
+	}
+	g_free(probe);
+
+	return 0;
+
+ err:
+	err = errno;
+	UTIL_ERR("uring backend: %s", strerror(err));
+	g_free(probe);
+	__uring_unmap(u);
+	errno = err;
+
+	return -1;
+}
+
+/* a forked child must not share the queues of its parent */
+static void __uring_atfork(void)
+{
+	uring.forked = 1;
+}
+
+/* with uring_lock held, the ring of this process */
+static struct uring *__uring_get(void)
+{
+	static int atfork;
+
+	if (uring.fd != -1 && !uring.forked)
+		return &uring;
+
+	if (!atfork)
+		atfork = pthread_atfork(NULL, NULL, __uring_atfork) == 0;
+
+	__uring_unmap(&uring);
+	if (__uring_map(&uring) == -1)
+		return NULL;
+
+	return &uring;
+}
+
+/* the i-th entry queued after the last submission */
+static struct io_uring_sqe *__uring_sqe(struct uring *u, int i)
+{
+	unsigned int idx = (*u->sq_tail + i) & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[idx];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->user_data = i;
+	u->sq_array[idx] = idx;
+
+	return sqe;
+}
+
+/* submits the n entries queued, results by entry in res */
+static int __uring_submit(struct uring *u, int n, int *res)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int head;
+	unsigned int todo;
+	int done;
+
+	__atomic_store_n(u->sq_tail, *u->sq_tail + n, __ATOMIC_RELEASE);
+
+	for (done = 0; done < n;) {
+		todo = *u->sq_tail - __atomic_load_n(u->sq_head,
+						     __ATOMIC_ACQUIRE);
+		if (syscall(__NR_io_uring_enter, u->fd, todo, n - done,
+			    IORING_ENTER_GETEVENTS, NULL, 0) == -1 &&
+		    errno != EINTR) {
+			/* entries of the kernel may complete later, drop
+			 * the ring rather than take their results for others */
+			UTIL_ERR("uring backend: enter: %s", strerror(errno));
+			__uring_unmap(u);
+			return -1;
+		}
+
+		head = *u->cq_head;
+		while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &u->cqes[head & *u->cq_mask];
+			if (cqe->user_data < (unsigned int)n)
+				res[cqe->user_data] = cqe->res;
+			head++;
+			done++;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+
+static int __uring_setup(void)
+{
+	int r;
+
+	if (__get_kern_ver() < KERNEL_VERSION(5, 15, 0)) {
+		UTIL_ERR("io_uring direct descriptors require kernel version >= 5.15");
+		errno = ENOSYS;
+		return -1;
+	}
+
+	G_LOCK(uring);
+	r = __uring_get() ? 0 : -1;
+	G_UNLOCK(uring);
+
+	return r;
+}
+
+/* the open and the close of the key file in one system call */
+static int __uring_publish(const char *noti)
+{
+	char notipath[FILENAME_MAX];
+	struct io_uring_sqe *sqe;
+	struct uring *u;
+	int res[2];
+	int r;
+
+	if (strchr(noti, '/'))
+		snprintf(notipath, sizeof(notipath), "%s", noti);
+	else
+		__make_noti_path(notipath, sizeof(notipath), noti);
+
+	r = -1;
+	G_LOCK(uring);
+	u = __uring_get();
+	if (u) {
+		sqe = __uring_sqe(u, 0);
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->flags = IOSQE_IO_LINK;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)notipath;
+		sqe->open_flags = O_TRUNC | O_WRONLY;
+		sqe->file_index = 1;	/* slot 0 */
+
+		sqe = __uring_sqe(u, 1);
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->file_index = 1;
+
+		r = __uring_submit(u, 2, res);
+	}
+	G_UNLOCK(uring);
+
+	/* releasing the direct descriptor is the event */
+	if (r == 0 && res[0] >= 0)
+		return 0;
+
+	/* the other layout, and errno, are found the plain way */
+	return __inotify_publish(noti);
+}
+
+/* the keys of a batch on slots of their own, one system call a batch */
+static void __uring_publish_many(const char *const *names, int n, int *err)
+{
+	char path[URING_SLOTS][NAME_MAX + 4];	/* a shard and a name */
+	struct io_uring_sqe *sqe;
+	struct uring *u;
+	int res[URING_ENTRIES];
+	int key[URING_SLOTS];	/* of each slot */
+	int dirfd;
+	int cnt;
+	int r;
+	int i;
+	int j;
+
+	for (i = 0; i < n;) {
+		r = -1;
+		cnt = 0;
+		G_LOCK(uring);
+		u = __uring_get();
+		for (; u && cnt < URING_SLOTS && i < n; i++) {
+			if (__batch_path(names[i], path[cnt], sizeof(path[0]),
+					 &dirfd) == -1) {
+				err[i] = -1;	/* by the plain way below */
+				continue;
+			}
+
+			sqe = __uring_sqe(u, 2 * cnt);
+			sqe->opcode = IORING_OP_OPENAT;
+			sqe->flags = IOSQE_IO_LINK;
+			sqe->fd = dirfd;
+			sqe->addr = (uintptr_t)path[cnt];
+			sqe->open_flags = O_TRUNC | O_WRONLY;
+			sqe->file_index = cnt + 1;
+
+			sqe = __uring_sqe(u, 2 * cnt + 1);
+			sqe->opcode = IORING_OP_CLOSE;
+			sqe->file_index = cnt + 1;
+
+			key[cnt++] = i;
+		}
+		if (cnt > 0)
+			r = __uring_submit(u, 2 * cnt, res);
+		G_UNLOCK(uring);
+
+		for (j = 0; j < cnt; j++)
+			err[key[j]] = r == 0 && res[2 * j] >= 0 ? 0 : -1;
+
+		/* no ring: the rest of the keys are published plainly */
+		if (u == NULL) {
+			for (; i < n; i++)
+				err[i] = -1;
+		}
+	}
+
+	/* the other layout, and errno, are found the plain way */
+	for (i = 0; i < n; i++) {
+		if (err[i] == -1)
+			err[i] = __inotify_publish(names[i]) == -1 ? errno : 0;
+	}
+}
+
+static ssize_t __uring_read(int fd, void *buf, size_t size)
+{
+	struct io_uring_sqe *sqe;
+	struct uring *u;
+	int res[1];
+	int r;
+
+	r = -1;
+	G_LOCK(uring);
+	u = __uring_get();
+	if (u) {
+		sqe = __uring_sqe(u, 0);
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (uintptr_t)buf;
+		sqe->len = size;
+		sqe->off = (uint64_t)-1;
+
+		r = __uring_submit(u, 1, res);
+	}
+	G_UNLOCK(uring);
+
+	if (r == -1)
+		return read(fd, buf, size);
+	if (res[0] < 0) {
+		errno = -res[0];
+		return -1;
+	}
+
+	return res[0];
+}
+
+/* one system call a read, no FIONREAD before it */
+static int __uring_drain(int fd, struct noti_cont *nc)
+{
+	return __read_events(fd, nc, __uring_read, 0);
+}
+#endif
+
+static const struct noti_backend inotify_backend = {
+	.name = "inotify",
+	.init = __inotify_init,
+	.fini = __inotify_fini,
+	.watch = __inotify_watch,
+	.unwatch = __inotify_unwatch,
+	.publish = __inotify_publish,
+	.publish_many = __inotify_publish_many,
+	.drain = __inotify_drain,
+};
+
+static const struct noti_backend shm_backend = {
+	.name = "shm",
+	.named = 1,
+	.setup = __shm_setup,
+	.init = __shm_init,
+	.fini = __shm_fini,
+	.watch = __shm_watch,
+	.unwatch = __shm_unwatch,
+	.publish = __shm_publish,
+	.drain = __shm_drain,
+};
+
+static const struct noti_backend broker_backend = {
+	.name = "broker",
+	.named = 1,
+	.setup = __broker_setup,
+	.init = __broker_init,
+	.fini = __broker_fini,
+	.watch = __broker_watch,
+	.unwatch = __broker_unwatch,
+	.watch_all = __broker_watch_all,
+	.publish = __broker_publish,
+	.publish_many = __broker_publish_many,
+	.drain = __broker_drain,
+};
+
+#ifdef HAVE_IO_URING
+static const struct noti_backend uring_backend = {
+	.name = "uring",
+	.setup = __uring_setup,
+	.init = __inotify_init,
+	.fini = __inotify_fini,
+	.watch = __inotify_watch,
+	.unwatch = __inotify_unwatch,
+	.publish = __uring_publish,
+	.publish_many = __uring_publish_many,
+	.drain = __uring_drain,
+};
+#endif
+
+static const struct noti_backend *backends[] = {
+	&inotify_backend,
+	&shm_backend,
+	&broker_backend,
+#ifdef HAVE_IO_URING
+	&uring_backend,
+#endif
+};
+
+static const struct noti_backend *__find_backend(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+		if (strcmp(backends[i]->name, name) == 0)
+			return backends[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * The backend of the process: set by heynoti_set_backend(), else named
+ * by HEYNOTI_BACKEND in the environment or at build time. One that
+ * cannot be used falls back to inotify.
+ */
+static const struct noti_backend *__backend(void)
+{
+	const struct noti_backend *be;
+	const char *name;
+
+	be = g_atomic_pointer_get(&backend);
+	if (be)
+		return be;
+
+	G_LOCK(backend);
+	if (backend == NULL) {
+		name = getenv("HEYNOTI_BACKEND");
+		if (name == NULL || *name == '\0')
+			name = HEYNOTI_BACKEND;
+
+		be = __find_backend(name);
+		if (be == NULL || (be->setup && be->setup() == -1)) {
+			UTIL_ERR("backend %s unusable, using inotify", name);
+			be = &inotify_backend;
+		}
+		g_atomic_pointer_set(&backend, be);
+	}
+	be = backend;
+	G_UNLOCK(backend);
+
+	return be;
+}
+
+API int heynoti_set_backend(const char *name)
+{
+	const struct noti_backend *be;
+	int r;
+
+	be = name ? __find_backend(name) : NULL;
+	if (be == NULL) {
+		UTIL_DBG("Error: set backend: %s: unknown", name);
+		errno = EINVAL;
+		return -1;
+	}
+
+	G_LOCK(backend);
+	r = be->setup ? be->setup() : 0;
+	if (r == 0)
+		g_atomic_pointer_set(&backend, be);
+	G_UNLOCK(backend);
+
+	return r;
+}
+
+API const char *heynoti_get_backend(void)
+{
+	return __backend()->name;
+}
+
+API int heynoti_publish(const char *noti)
+{
+	if (noti == NULL) {
+		UTIL_DBG("Error: send noti: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	util_retvm_if(__backend()->publish(noti) == -1, -1,
+		      "Error: send noti: %s", strerror(errno));
+
+	if (strchr(noti, '/') == NULL)
+		__reg_touch(noti);
+
+	return 0;
+}
+
+API int heynoti_publish_many(const char *const names[], int n, int *results)
+{
+	const struct noti_backend *be;
+	int *err;
+	int cnt;
+	int i;
+
+	for (i = 0; names && i < n; i++) {
+		if (names[i] == NULL)
+			break;
+	}
+	if (names == NULL || n < 0 || i < n) {
+		UTIL_DBG("Error: send noti many: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	err = results ? results : g_new(int, n);
+
+	be = __backend();
+	if (be->publish_many)
+		be->publish_many(names, n, err);
+	else {
+		for (i = 0; i < n; i++)
+			err[i] = be->publish(names[i]) == -1 ? errno : 0;
+	}
+
+	cnt = 0;
+	for (i = 0; i < n; i++) {
+		if (err[i] != 0) {
+			UTIL_DBG("Error: send noti: %s : %s", names[i],
+				 strerror(err[i]));
+			continue;
+		}
+		if (strchr(names[i], '/') == NULL)
+			__reg_touch(names[i]);
+		cnt++;
+	}
+
+	if (results == NULL)
+		g_free(err);
+
+	return cnt;
+}
+
+API int heynoti_publish_data(const char *noti, const void *buf, int len)
+{
+	int fd;
+	int dfd;
+	int err;
+	char notipath[FILENAME_MAX];
+	char datapath[FILENAME_MAX];
+	struct noti_payload *p;
+	struct stat sb;
+	struct stat db;
+	const struct noti_backend *be;
+
+	if (noti == NULL || len < 0 || len > HEYNOTI_PAYLOAD_MAX ||
+	    (buf == NULL && len > 0)) {
+		UTIL_DBG("Error: send noti data: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+
+	/*
+	 * A key must exist; its file is held open until the payload is in.
+	 * Closing it is the event, unless the backend publishes the key.
+	 */
+	be = __backend();
+	fd = __open_noti(noti, (be->named && strchr(noti, '/') == NULL ?
+				O_RDONLY : O_TRUNC | O_WRONLY) | O_CLOEXEC,
+			 notipath, sizeof(notipath));
+	util_retvm_if(fd == -1, -1, "Error: send noti: %s", strerror(errno));
+
+	dfd = -1;
+	if (fstat(fd, &sb) == -1)
+		goto err;
+	if (__make_data_path(datapath, sizeof(datapath), noti) >=
+	    (int)sizeof(datapath)) {
+		errno = ENAMETOOLONG;
+		goto err;
+	}
+
+	dfd = open(datapath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (dfd == -1 || fstat(dfd, &db) == -1)
+		goto err;
+
+	/* only ever grown, a mapping of it must not fault */
+	if (db.st_size < PAYLOAD_SIZE) {
+		if (ftruncate(dfd, PAYLOAD_SIZE) == -1)
+			goto err;
+		/* as the key file, regardless of the umask */
+		if (fchmod(dfd, sb.st_mode & 0666) == -1)
+			UTIL_DBG("chmod payload: %s : %s", datapath,
+				 strerror(errno));
+	}
+
+	p = mmap(NULL, PAYLOAD_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dfd,
+		 0);
+	if (p == MAP_FAILED)
+		goto err;
+	close(dfd);
+	dfd = -1;
+
+	__seq_lock(&p->seq, 1);
+	p->len = len;
+	if (len > 0)
+		memcpy(p->data, buf, len);
+	__atomic_store_n(&p->magic, PAYLOAD_MAGIC, __ATOMIC_RELAXED);
+	__seq_unlock(&p->seq);
+	munmap(p, PAYLOAD_SIZE);
+
+	if (strchr(noti, '/') == NULL) {
+		__reg_touch(noti);
+
+		if (be->named && be->publish(noti) == -1)
+			goto err;
+	}
+
+	close(fd);
+	return 0;
+
+ err:
+	err = errno;
+	UTIL_ERR("Error: send noti data: %s : %s", notipath, strerror(err));
+	if (dfd != -1)
+		close(dfd);
+	close(fd);
+	errno = err;
+	return -1;
+}
+
+static int __init_cont(int dir)
+{
+	int r;
+	int fd;
+
+	struct noti_cont *nc;
+
+	r = __make_noti_root(noti_root);
+	if (r == -1) {
+		UTIL_ERR("make noti root: %s : %s", noti_root, strerror(errno));
+		return -1;
+	}
+
+	nc = calloc(1, sizeof(struct noti_cont));
+	if (nc == NULL)
+		return -1;
+
+	nc->buf = malloc(EVENT_BUF_DEFAULT);
+	if (nc->buf == NULL) {
+		free(nc);
+		return -1;
+	}
+
+	/* named keys are routed as in directory mode */
+	nc->be = __backend();
+	nc->dir_mode = dir || nc->be->named;
+
+	fd = nc->be->init(nc);
+	if (fd == -1) {
+		free(nc->buf);
+		free(nc);
+		return -1;
+	}
+
+	nc->fd = fd;
+	nc->buf_size = EVENT_BUF_DEFAULT;
+	nc->buf_want = -1;
+	nc->wd_tbl = g_hash_table_new(g_direct_hash, g_direct_equal);
+	nc->path_tbl = g_hash_table_new(g_str_hash, g_str_equal);
+	__slab_init(&nc->slots, sizeof(struct noti_slot), __slot_init);
+	__slab_init(&nc->wds, sizeof(struct noti_wd), NULL);
+	nc->names = g_string_chunk_new(FILENAME_MAX);
+	nc->pending = g_ptr_array_new();
+	nc->events = g_array_new(FALSE, FALSE, sizeof(struct heynoti_event));
+	nc->fired = g_ptr_array_new();
+	nc->pats = g_ptr_array_new();
+	nc->timers = g_ptr_array_new();
+	nc->tfd = -1;
+	g_mutex_init(&nc->lock);
+	nc->snap = g_malloc0(sizeof(struct noti_snap));
+	nc->dirty = g_array_new(FALSE, FALSE, sizeof(int));
+	/*sglib_ncont_add(&nc_h, nc); */
+	__set_noti_cont(fd, nc);
+
+	return fd;
+}
+
+API int heynoti_init()
+{
+	return __init_cont(0);
+}
+
+API int heynoti_init_dir(void)
+{
+	return __init_cont(1);
+}
+
+API int heynoti_set_event_buffer(int fd, int size)
 {
-	int r;
-	int wd;
 	struct noti_cont *nc;
-	struct noti_slot t, *n;
-	struct noti_slot *f = NULL;
-	GList *it;
 
 	nc = __get_noti_cont(fd);
 	if (nc == NULL) {
-		UTIL_DBG("Bad file descriptor");
+		UTIL_ERR("Non-registered file descriptor : %d", fd);
 		errno = EBADF;
 		return -1;
 	}
 
-	wd = __get_wd(fd, notipath);
-	util_retvm_if(wd == -1, -1, "Error: add noti: %s", strerror(errno));
+	if (size < 0 || size > EVENT_BUF_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
 
-	for (it = nc->g_ns; it != NULL; it = g_list_next(it)) {
-		if (it->data) {
-			f = (struct noti_slot *)it->data;
-			if (f->wd == wd && f->cb == cb) {
-				break;
-			} else {
-				f = NULL;
+	if (size > 0 && size < (int)EVENT_BUF_MIN)
+		size = EVENT_BUF_MIN;
+
+	/* the reader resizes its buffer when no events are walked */
+	g_atomic_int_set(&nc->buf_want, size);
+
+	return 0;
+}
+
+API int heynoti_get_event_count(int fd)
+{
+	struct noti_cont *nc;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_ERR("Non-registered file descriptor : %d", fd);
+		errno = EBADF;
+		return -1;
+	}
+
+	return nc->n_event;
+}
+
+/* start of pid in seconds of the realtime clock, or -1 */
+static time_t __pid_start(pid_t pid)
+{
+	char path[64];
+	char buf[1024];
+	char *p;
+	struct timespec real;
+	struct timespec boot;
+	unsigned long long start;
+	int i;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if (__read_proc(path, buf, sizeof(buf) - 1) <= 0)
+		return -1;
+
+	/* starttime is the 20th field after the command name */
+	p = strrchr(buf, ')');
+	for (i = 0; p != NULL && i < 20; i++)
+		p = strchr(p + 1, ' ');
+	if (p == NULL || sscanf(p, "%llu", &start) != 1)
+		return -1;
+
+	if (clock_gettime(CLOCK_REALTIME, &real) == -1 ||
+	    clock_gettime(CLOCK_BOOTTIME, &boot) == -1)
+		return -1;
+
+	return real.tv_sec - boot.tv_sec + start / sysconf(_SC_CLK_TCK);
+}
+
+/*
+ * A .<pid>_<name> file is stale once pid is gone, or when pid belongs
+ * to a process started after the file last changed, so not its owner.
+ */
+static int __pnoti_stale(const char *name, const struct stat *sb)
+{
+	char *end;
+	long pid;
+	time_t start;
+
+	if (name[0] != '.' || name[1] < '0' || name[1] > '9')
+		return 0;
+
+	errno = 0;
+	pid = strtol(name + 1, &end, 10);
+	if (errno || *end != '_' || end[1] == '\0' || pid <= 0)
+		return 0;
+
+	if (kill(pid, 0) == -1 && errno == ESRCH)
+		return 1;
+
+	/* a second of slack for the rounding of the start time */
+	start = __pid_start(pid);
+	return start != -1 && start > sb->st_ctime + 1;
+}
+
+/* removes the stale pnoti files of dir, returns how many */
+static int __gc_dir(const char *dirpath)
+{
+	char path[FILENAME_MAX];
+	char tmp[FILENAME_MAX];
+	struct stat sb;
+	struct stat tb;
+	struct dirent *de;
+	DIR *dir;
+	int n;
+
+	dir = opendir(dirpath);
+	if (dir == NULL)
+		return 0;
+
+	n = 0;
+	while ((de = readdir(dir)) != NULL) {
+		snprintf(path, sizeof(path), "%s/%s", dirpath, de->d_name);
+		if (lstat(path, &sb) == -1 || !S_ISREG(sb.st_mode) ||
+		    !__pnoti_stale(de->d_name, &sb))
+			continue;
+
+		/*
+		 * A process reusing the pid may make the file again meanwhile:
+		 * move it aside and delete it only if it is still the file
+		 * judged, else put the new one back.
+		 */
+		snprintf(tmp, sizeof(tmp), "%s/.gc%d%s", dirpath, getpid(),
+			 de->d_name);
+		if (rename(path, tmp) == -1)
+			continue;
+
+		if (lstat(tmp, &tb) == 0 && tb.st_ino == sb.st_ino &&
+		    tb.st_dev == sb.st_dev) {
+			if (unlink(tmp) == 0) {
+				heynoti_unregister_key(de->d_name);
+				n++;
 			}
+			continue;
 		}
+
+		if (link(tmp, path) == -1)
+			UTIL_ERR("gc: restore %s : %s", path, strerror(errno));
+		unlink(tmp);
 	}
+	closedir(dir);
 
-	if (f) {
-		__add_wd(nc, wd, 0, notipath);
-		errno = EALREADY;
+	return n;
+}
+
+API int heynoti_gc_pnoti(void)
+{
+	char path[FILENAME_MAX];
+	int n;
+	int i;
+
+	n = __gc_dir(noti_root);
+
+	for (i = 0; __sharded() && i < NOTI_SHARDS; i++) {
+		snprintf(path, sizeof(path), "%s/%02x", noti_root, i);
+		n += __gc_dir(path);
+	}
+
+	UTIL_DBG("gc: %d stale pnoti files removed", n);
+
+	return n;
+}
+
+API int heynoti_get_pnoti_name(pid_t pid, const char *name, char *buf,
+			       int buf_size)
+{
+	int ret;
+
+	if (!name)
+		return -1;
+
+	ret = snprintf(buf, buf_size, ".%d_%s", pid, name);
+
+	if (ret >= buf_size)
+		return -1;
+	else
+		return 0;
+}
+
+API int heynoti_get_noti_path(const char *name, char *buf, int buf_size)
+{
+	int ret;
+
+	if (!name)
+		return -1;
+
+	ret = __make_noti_path(buf, buf_size, name);
+
+	if (ret >= buf_size)
+		return -1;
+	else
+		return 0;
+}
+
+API int heynoti_migrate_sharded(void)
+{
+	char path[FILENAME_MAX];
+	char dst[FILENAME_MAX];
+	struct stat sb;
+	struct dirent *de;
+	DIR *dir;
+	int fd;
+	int i;
+	int n;
+
+	util_retvm_if(stat(noti_root, &sb) == -1, -1, "noti root: %s : %s",
+		      noti_root, strerror(errno));
+
+	for (i = 0; i < NOTI_SHARDS; i++) {
+		snprintf(path, sizeof(path), "%s/%02x", noti_root, i);
+		if (mkdir(path, sb.st_mode & 07777) == -1) {
+			util_retvm_if(errno != EEXIST, -1, "make shard: %s : %s",
+				      path, strerror(errno));
+			continue;
+		}
+		/* as noti_root, regardless of the umask */
+		chmod(path, sb.st_mode & 07777);
+		if (chown(path, sb.st_uid, sb.st_gid) == -1)
+			UTIL_DBG("chown shard: %s : %s", path, strerror(errno));
+	}
+
+	/* new paths are sharded from here on, flat ones are still found */
+	snprintf(path, sizeof(path), "%s/%s", noti_root, NOTI_SHARD_MARKER);
+	fd = open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+	util_retvm_if(fd == -1, -1, "make shard marker: %s : %s", path,
+		      strerror(errno));
+	close(fd);
+	g_atomic_int_set(&sharded, 1);
+
+	dir = opendir(noti_root);
+	util_retvm_if(dir == NULL, -1, "open noti root: %s : %s", noti_root,
+		      strerror(errno));
+
+	/* renaming keeps the inodes, so existing watches keep working */
+	n = 0;
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp(de->d_name, NOTI_META, strlen(NOTI_META)) == 0)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", noti_root, de->d_name);
+		if (lstat(path, &sb) == -1 || !S_ISREG(sb.st_mode))
+			continue;
+
+		__make_noti_path(dst, sizeof(dst), de->d_name);
+		if (rename(path, dst) == -1) {
+			UTIL_ERR("migrate: %s : %s", path, strerror(errno));
+			continue;
+		}
+		n++;
+	}
+	closedir(dir);
+
+	return n;
+}
+
+/* the registry as this process maps it, for lookups and publishes */
+static struct reg_map reg = { -1, 0, 0, NULL };
+static time_t reg_retry;	/* a missing registry is not looked up before */
+G_LOCK_DEFINE_STATIC(reg);
+
+#define REG_SCAN	0x01	/* keys of the noti files, else of old */
+#define REG_REPLACE	0x02	/* rename over the registry, else link */
+
+static inline struct reg_ent *__reg_ents(struct reg_hdr *h)
+{
+	return (struct reg_ent *)(h + 1);
+}
+
+static int64_t __usec(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static int64_t __usec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return __usec(&ts);
+}
+
+static int __reg_map_fd(int fd, int writable, struct reg_map *m)
+{
+	struct stat sb;
+	struct reg_hdr *h;
+	size_t n;
+
+	if (fstat(fd, &sb) == -1)
+		return -1;
+	if (sb.st_size < (off_t)sizeof(struct reg_hdr)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	h = mmap(NULL, sb.st_size, PROT_READ | (writable ? PROT_WRITE : 0),
+		 MAP_SHARED, fd, 0);
+	if (h == MAP_FAILED)
 		return -1;
+
+	n = h->n_slots;
+	if (h->magic != REG_MAGIC || h->version != REG_VERSION || n == 0 ||
+	    (n & (n - 1)) ||
+	    sb.st_size != sizeof(struct reg_hdr) + n * sizeof(struct reg_ent)) {
+		UTIL_ERR("registry: bad file, to be rebuilt");
+		munmap(h, sb.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	m->fd = fd;
+	m->writable = writable;
+	m->size = sb.st_size;
+	m->h = h;
+
+	return 0;
+}
+
+static void __reg_unmap(struct reg_map *m)
+{
+	if (m->h)
+		munmap(m->h, m->size);
+	if (m->fd != -1)
+		close(m->fd);
+	m->h = NULL;
+	m->fd = -1;
+}
+
+/* a consistent copy of e */
+static int __reg_read(const struct reg_ent *e, struct reg_ent *out)
+{
+	uint32_t seq;
+
+	do {
+		if (__seq_begin(&e->seq, &seq) == -1)
+			return -1;
+		memcpy(out, e, sizeof(*out));
+	} while (__seq_retry(&e->seq, seq));
+	out->name[REG_NAME_MAX] = '\0';
+
+	return 0;
+}
+
+/* lock free lookup: the index of name copied to out, else -1 */
+static int __reg_lookup(struct reg_hdr *h, const char *name, uint32_t hash,
+			struct reg_ent *out)
+{
+	struct reg_ent *ents = __reg_ents(h);
+	uint32_t mask = h->n_slots - 1;
+	uint32_t i;
+	uint32_t n;
+
+	for (n = 0, i = hash & mask; n < h->n_slots; n++, i = (i + 1) & mask) {
+		if (__reg_read(&ents[i], out) == -1)
+			return -1;
+		if (out->state == REG_EMPTY)
+			break;
+		if (out->state == REG_USED && out->hash == hash &&
+		    strcmp(out->name, name) == 0)
+			return i;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+/*
+ * Under the flock, names and states are stable: the entry of name, or
+ * with insert a free one for it.
+ */
+static struct reg_ent *__reg_slot(struct reg_hdr *h, const char *name,
+				  uint32_t hash, int insert)
+{
+	struct reg_ent *ents = __reg_ents(h);
+	struct reg_ent *free = NULL;
+	uint32_t mask = h->n_slots - 1;
+	uint32_t i;
+	uint32_t n;
+
+	for (n = 0, i = hash & mask; n < h->n_slots; n++, i = (i + 1) & mask) {
+		if (ents[i].state == REG_EMPTY) {
+			if (free == NULL)
+				free = &ents[i];
+			break;
+		}
+		if (ents[i].state == REG_DELETED) {
+			if (free == NULL)
+				free = &ents[i];
+			continue;
+		}
+		if (ents[i].hash == hash && strcmp(ents[i].name, name) == 0)
+			return &ents[i];
+	}
+
+	return insert ? free : NULL;
+}
+
+/* adds the noti files of dirpath to keys, dated from old if it has them */
+static void __reg_scan(const char *dirpath, struct reg_map *old, GArray *keys)
+{
+	char path[FILENAME_MAX];
+	struct stat sb;
+	struct dirent *de;
+	struct reg_ent x;
+	struct reg_ent *e;
+	DIR *dir;
+
+	dir = opendir(dirpath);
+	if (dir == NULL)
+		return;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strncmp(de->d_name, NOTI_META, strlen(NOTI_META)) == 0 ||
+		    strlen(de->d_name) > REG_NAME_MAX)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dirpath, de->d_name);
+		if (lstat(path, &sb) == -1 || !S_ISREG(sb.st_mode))
+			continue;
+
+		memset(&x, 0, sizeof(x));
+		memcpy(x.name, de->d_name, strlen(de->d_name) + 1);
+		x.hash = __fnv1a(x.name);
+		x.mode = sb.st_mode & 07777;
+		x.created = __usec(&sb.st_mtim);
+
+		e = old ? __reg_slot(old->h, x.name, x.hash, 0) : NULL;
+		if (e) {
+			x.created = e->created;
+			x.published = __atomic_load_n(&e->published,
+						      __ATOMIC_RELAXED);
+		}
+		g_array_append_val(keys, x);
+	}
+	closedir(dir);
+}
+
+/*
+ * Writes the keys of the noti files, or of old, to a new registry at
+ * most half full, and puts it in place locked. The file is never
+ * resized, so no mapping of it may fault past its end.
+ */
+static int __reg_build(struct reg_map *old, int flags, struct reg_map *m)
+{
+	char path[FILENAME_MAX];
+	char tmp[FILENAME_MAX + 16];	/* path and a pid */
+	GArray *keys;
+	struct reg_hdr *h = MAP_FAILED;
+	struct reg_ent *x;
+	struct reg_ent *e;
+	uint32_t n_slots;
+	uint32_t i;
+	size_t size = 0;
+	int fd = -1;
+	int r;
+
+	keys = g_array_new(FALSE, FALSE, sizeof(struct reg_ent));
+	if (flags & REG_SCAN) {
+		__reg_scan(noti_root, old, keys);
+		for (i = 0; __sharded() && i < NOTI_SHARDS; i++) {
+			snprintf(path, sizeof(path), "%s/%02x", noti_root, i);
+			__reg_scan(path, old, keys);
+		}
+	} else {
+		for (i = 0; i < old->h->n_slots; i++) {
+			e = &__reg_ents(old->h)[i];
+			if (e->state != REG_USED)
+				continue;
+			g_array_append_val(keys, *e);
+			x = &g_array_index(keys, struct reg_ent, keys->len - 1);
+			x->published = __atomic_load_n(&e->published,
+						       __ATOMIC_RELAXED);
+		}
+	}
+
+	for (n_slots = REG_SLOTS_MIN; n_slots / 2 < keys->len + 1;)
+		n_slots *= 2;
+	size = sizeof(struct reg_hdr) + (size_t)n_slots * sizeof(struct reg_ent);
+
+	snprintf(path, sizeof(path), "%s/%s", noti_root, REG_FILE);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	unlink(tmp);
+	fd = open(tmp, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0666);
+	if (fd == -1)
+		goto err;
+
+	/* publishers of any user stamp it, regardless of the umask */
+	fchmod(fd, 0666);
+	if (flock(fd, LOCK_EX) == -1 || ftruncate(fd, size) == -1)
+		goto err;
+	h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (h == MAP_FAILED)
+		goto err;
+
+	h->magic = REG_MAGIC;
+	h->version = REG_VERSION;
+	h->n_slots = n_slots;
+	for (i = 0; i < keys->len; i++) {
+		x = &g_array_index(keys, struct reg_ent, i);
+		e = __reg_slot(h, x->name, x->hash, 1);
+		/* flat and sharded copies in the middle of a migration */
+		if (e->state == REG_USED)
+			continue;
+		*e = *x;
+		e->seq = 0;
+		e->state = REG_USED;
+		h->n_used++;
+	}
+	g_array_free(keys, TRUE);
+	keys = NULL;
+
+	if (flags & REG_REPLACE) {
+		r = rename(tmp, path);
+	} else {
+		/* fails with EEXIST if another process made it first */
+		r = link(tmp, path);
+		if (r == 0)
+			unlink(tmp);
+	}
+	if (r == -1)
+		goto err;
+
+	if (old)
+		__atomic_store_n(&old->h->replaced, 1, __ATOMIC_RELEASE);
+
+	m->fd = fd;
+	m->writable = 1;
+	m->size = size;
+	m->h = h;
+
+	return 0;
+
+ err:
+	r = errno;
+	if (h != MAP_FAILED)
+		munmap(h, size);
+	if (fd != -1) {
+		unlink(tmp);
+		close(fd);
 	}
+	if (keys)
+		g_array_free(keys, TRUE);
+	errno = r;
+
+	return -1;
+}
+
+/* maps the registry locked for writing, made first if create is set */
+static int __reg_lock(struct reg_map *m, int create)
+{
+	char path[FILENAME_MAX];
+	struct stat sb;
+	struct stat fb;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", noti_root, REG_FILE);
+	for (;;) {
+		fd = open(path, O_RDWR | O_CLOEXEC);
+		if (fd == -1) {
+			if (errno != ENOENT || !create)
+				return -1;
+			if (__reg_build(NULL, REG_SCAN, m) == 0)
+				return 0;
+			if (errno == EEXIST)
+				continue;
+			return -1;
+		}
+
+		if (flock(fd, LOCK_EX) == -1) {
+			close(fd);
+			return -1;
+		}
+
+		if (fstat(fd, &fb) == -1) {
+			close(fd);
+			return -1;
+		}
 
-	r = __add_wd(nc, wd, mask, notipath);
-	util_retvm_if(r == -1, -1, "Error: add noti: %s", strerror(errno));
+		/* renamed over or removed while waiting for the lock */
+		if (stat(path, &sb) == -1 || fb.st_ino != sb.st_ino ||
+		    fb.st_dev != sb.st_dev) {
+			close(fd);
+			continue;
+		}
+
+		if (__reg_map_fd(fd, 1, m) == -1) {
+			close(fd);
+			return -1;
+		}
+
+		return 0;
+	}
+}
 
-	n = calloc(1, sizeof(nslot));
-	util_retvm_if(n == NULL, -1, "Error: add noti: %s", strerror(errno));
+/* a free entry for name, moving to a larger registry when 3/4 full */
+static struct reg_ent *__reg_insert(struct reg_map *m, const char *name,
+				   uint32_t hash)
+{
+	struct reg_map n = { -1, 0, 0, NULL };
 
-	n->wd = wd;
-	n->cb_data = data;
-	n->cb = cb;
-	n->mask = mask;
-	nc->g_ns = g_list_append(nc->g_ns, (gpointer) n);
+	if ((m->h->n_used + m->h->n_deleted + 1) * 4 > m->h->n_slots * 3) {
+		if (__reg_build(m, REG_REPLACE, &n) == -1)
+			return NULL;
+		__reg_unmap(m);
+		*m = n;
+	}
 
-	return 0;
+	return __reg_slot(m->h, name, hash, 1);
 }
 
-API int heynoti_subscribe(int fd, const char *noti, void (*cb) (void *),
-			  void *data)
+/* the registry mapped for this process, under G_LOCK(reg) */
+static struct reg_hdr *__reg_get(void)
 {
-	char notipath[FILENAME_MAX];
+	char path[FILENAME_MAX];
+	int writable;
+	int fd;
 
-	if (noti == NULL || cb == NULL) {
-		UTIL_DBG("Error: add noti: Invalid input");
-		errno = EINVAL;
-		return -1;
+	if (reg.h && !__atomic_load_n(&reg.h->replaced, __ATOMIC_ACQUIRE))
+		return reg.h;
+	if (reg.h == NULL && time(NULL) < reg_retry) {
+		errno = ENODATA;
+		return NULL;
+	}
+	__reg_unmap(&reg);
+
+	snprintf(path, sizeof(path), "%s/%s", noti_root, REG_FILE);
+	writable = 1;
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd == -1 && errno == EACCES) {
+		writable = 0;
+		fd = open(path, O_RDONLY | O_CLOEXEC);
 	}
 
-	__make_noti_path(notipath, sizeof(notipath), noti);
-	UTIL_DBG("add watch: [%s]", notipath);
+	if (fd == -1 || __reg_map_fd(fd, writable, &reg) == -1) {
+		if (fd != -1)
+			close(fd);
+		reg_retry = time(NULL) + REG_RETRY;
+		errno = ENODATA;
+		return NULL;
+	}
 
-	return __add_noti(fd, notipath, cb, data, IN_CLOSE_WRITE | IN_DELETE);
+	return reg.h;
 }
 
-static int _del_noti(struct noti_cont *nc, int wd, void (*cb) (void *),
-		     const char *notipath)
+/* stamps the publish time of noti, if it is registered */
+static void __reg_touch(const char *noti)
 {
-	int r = 0;
-	struct noti_slot *t;
-	int n_del;
-	int n_remain;
-	GList *it;
-	GList *it_next;
-
-	n_del = 0;
-	n_remain = 0;
-
-	it = nc->g_ns;
-	while (it) {
-		it_next = it->next;
-
-		if (it->data) {
-			t = (struct noti_slot *)it->data;
-			if (t->wd == wd) {
-				if (cb == NULL || cb == t->cb) {
-					nc->g_ns = g_list_remove(nc->g_ns, t);
-					free(t);
-					n_del++;
-				} else {
-					n_remain++;
-				}
-			}
+	struct reg_hdr *h;
+	struct reg_ent x;
+	struct reg_ent *e;
+	int i;
+
+	if (strlen(noti) > REG_NAME_MAX)
+		return;
+
+	G_LOCK(reg);
+	h = __reg_get();
+	if (h && reg.writable &&
+	    (i = __reg_lookup(h, noti, __fnv1a(noti), &x)) != -1) {
+		e = &__reg_ents(h)[i];
+		if (__seq_lock(&e->seq, 0) == 0) {
+			if (e->state == REG_USED && strcmp(e->name, noti) == 0)
+				e->published = __usec_now();
+			__seq_unlock(&e->seq);
 		}
-
-		it = it_next;
 	}
+	G_UNLOCK(reg);
+}
 
-	if (n_remain == 0)
-		return inotify_rm_watch(nc->fd, wd);
+/* whether noti is registered, looked up in the mapping alone */
+static int __reg_has(const char *noti)
+{
+	struct reg_hdr *h;
+	struct reg_ent x;
+	int r;
 
-	r = __add_wd(nc, wd, 0, notipath);
+	if (strlen(noti) > REG_NAME_MAX)
+		return 0;
 
-	if (n_del == 0) {
-		UTIL_DBG("Error: nothing deleted");
-		errno = ENOENT;
-		return -1;
-	}
+	G_LOCK(reg);
+	h = __reg_get();
+	r = h ? __reg_lookup(h, noti, __fnv1a(noti), &x) : -1;
+	G_UNLOCK(reg);
 
-	return r;
+	return r != -1;
 }
 
-static int del_noti(int fd, const char *notipath, void (*cb) (void *))
+static int __check_key(const char *noti)
 {
-	int wd;
-	struct noti_cont *nc;
-
-	nc = __get_noti_cont(fd);
-	if (nc == NULL) {
-		UTIL_DBG("Bad file descriptor");
-		errno = EBADF;
+	if (noti == NULL || *noti == '\0' || strchr(noti, '/')) {
+		UTIL_DBG("Error: registry: Invalid input");
+		errno = EINVAL;
+		return -1;
+	}
+	if (strlen(noti) > REG_NAME_MAX) {
+		UTIL_DBG("Error: registry: too long key [%s]", noti);
+		errno = ENAMETOOLONG;
 		return -1;
 	}
 
-	/* get wd */
-	wd = __get_wd(fd, notipath);
-	util_retv_if(wd == -1, -1);
-
-	return _del_noti(nc, wd, cb, notipath);
+	return 0;
 }
 
-API int heynoti_unsubscribe(int fd, const char *noti, void (*cb) (void *))
+API int heynoti_get_key_info(const char *noti, struct heynoti_key_info *info)
 {
+	struct reg_hdr *h;
+	struct reg_ent x;
 	int r;
-	char notipath[FILENAME_MAX];
 
-	if (fd < 0 || noti == NULL) {
+	if (__check_key(noti) == -1)
+		return -1;
+	if (info == NULL) {
+		UTIL_DBG("Error: key info: Invalid input");
 		errno = EINVAL;
 		return -1;
 	}
 
-	__make_noti_path(notipath, sizeof(notipath), noti);
-	UTIL_DBG("del watch: [%s]", notipath);
+	G_LOCK(reg);
+	h = __reg_get();
+	r = h ? __reg_lookup(h, noti, __fnv1a(noti), &x) : -1;
+	G_UNLOCK(reg);
+	if (r == -1)
+		return -1;
 
-	r = del_noti(fd, notipath, cb);
-	util_warn_if(r == -1, "Error: del [%s]: %s", noti, strerror(errno));
+	info->mode = x.mode;
+	info->created = x.created;
+	info->published = x.published;
 
-	return r;
+	return 0;
 }
 
-API int heynoti_publish(const char *noti)
+API int heynoti_foreach_key(int (*cb) (const char *noti,
+				       const struct heynoti_key_info *info,
+				       void *data), void *data)
 {
-	int fd;
-	char *path;
-	char notipath[FILENAME_MAX];
-	struct stat sb;
-
-	if (noti == NULL) {
-		UTIL_DBG("Error: send noti: Invalid input");
+	struct heynoti_key_info info;
+	struct reg_hdr *h;
+	struct reg_ent x;
+	struct reg_ent *e;
+	GArray *keys;
+	guint i;
+	int n;
+
+	if (cb == NULL) {
+		UTIL_DBG("Error: foreach key: Invalid input");
 		errno = EINVAL;
 		return -1;
 	}
 
-	path = strstr(noti, "/");
-	if (path) {
-		snprintf(notipath, sizeof(notipath), "%s", noti);
-	} else {
-		__make_noti_path(notipath, sizeof(notipath), noti);
+	keys = g_array_new(FALSE, FALSE, sizeof(struct reg_ent));
+	G_LOCK(reg);
+	h = __reg_get();
+	for (i = 0; h && i < h->n_slots; i++) {
+		if (__reg_read(&__reg_ents(h)[i], &x) == 0 &&
+		    x.state == REG_USED)
+			g_array_append_val(keys, x);
 	}
-	UTIL_DBG("send noti: [%s]", notipath);
+	G_UNLOCK(reg);
 
-	fd = open(notipath, O_TRUNC | O_WRONLY);
-
-	util_retvm_if(fd == -1, -1, "Error: send noti: %s", strerror(errno));
+	if (h == NULL) {
+		g_array_free(keys, TRUE);
+		errno = ENODATA;
+		return -1;
+	}
 
-	/*
-	fstat(fd, &sb);
-	if(sb.st_uid != getuid())
-		fchown(fd, getuid(), getgid());
-	if(sb.st_mode & 0033)
-		fchmod(fd, 0644);
-	*/
+	/* unlocked, cb may look up keys itself */
+	n = 0;
+	for (i = 0; i < keys->len; i++) {
+		e = &g_array_index(keys, struct reg_ent, i);
+		info.mode = e->mode;
+		info.created = e->created;
+		info.published = e->published;
+		n++;
+		if (cb(e->name, &info, data))
+			break;
+	}
+	g_array_free(keys, TRUE);
 
-	close(fd);
-	return 0;
+	return n;
 }
 
-API int heynoti_init()
+API int heynoti_register_key(const char *noti, mode_t mode)
 {
-	int r;
-	int fd;
+	struct reg_map m = { -1, 0, 0, NULL };
+	struct reg_ent *e;
+	uint32_t hash;
 
-	struct noti_cont *nc;
+	if (__check_key(noti) == -1)
+		return -1;
 
-	if (__get_kern_ver() < KERNEL_VERSION(2, 6, 13)) {
-		UTIL_ERR("inotify requires kernel version >= 2.6.13 ");
-		errno = EPERM;
+	util_retvm_if(__reg_lock(&m, 1) == -1, -1, "registry: lock: %s",
+		      strerror(errno));
+
+	hash = __fnv1a(noti);
+	e = __reg_slot(m.h, noti, hash, 0);
+	if (e == NULL)
+		e = __reg_insert(&m, noti, hash);
+	if (e == NULL) {
+		UTIL_ERR("registry: add %s : %s", noti, strerror(errno));
+		__reg_unmap(&m);
 		return -1;
 	}
 
-	fd = inotify_init();
-	util_retvm_if(fd == -1, -1, "inotify init: %s", strerror(errno));
+	__seq_lock(&e->seq, 1);
+	if (e->state != REG_USED) {
+		if (e->state == REG_DELETED)
+			m.h->n_deleted--;
+		m.h->n_used++;
+		e->state = REG_USED;
+		e->hash = hash;
+		snprintf(e->name, sizeof(e->name), "%s", noti);
+		e->created = __usec_now();
+		e->published = 0;
+	}
+	e->mode = mode & 07777;
+	__seq_unlock(&e->seq);
+	__reg_unmap(&m);
 
-	fcntl(fd, F_SETFD, FD_CLOEXEC);
-	fcntl(fd, F_SETFL, O_NONBLOCK);
+	/* made just now, maybe */
+	G_LOCK(reg);
+	reg_retry = 0;
+	G_UNLOCK(reg);
 
-	r = __make_noti_root(noti_root);
-	if (r == -1) {
-		UTIL_ERR("make noti root: %s : %s", noti_root, strerror(errno));
-		close(fd);
+	return 0;
+}
+
+API int heynoti_unregister_key(const char *noti)
+{
+	char path[FILENAME_MAX];
+	struct reg_map m = { -1, 0, 0, NULL };
+	struct reg_ent *e;
+
+	if (__check_key(noti) == -1)
 		return -1;
-	}
 
-	nc = calloc(1, sizeof(struct noti_cont));
-	if (nc == NULL) {
-		close(fd);
+	/* a key made again must not get the payload of this one */
+	if (__make_data_path(path, sizeof(path), noti) < (int)sizeof(path) &&
+	    unlink(path) == -1 && errno != ENOENT)
+		UTIL_DBG("remove payload: %s : %s", path, strerror(errno));
+
+	if (__reg_lock(&m, 0) == -1) {
+		util_warn_if(errno != ENOENT, "registry: lock: %s",
+			     strerror(errno));
 		return -1;
 	}
 
-	nc->fd = fd;
-	/*sglib_ncont_add(&nc_h, nc); */
-	g_nc = g_list_append(g_nc, (gpointer) nc);
+	e = __reg_slot(m.h, noti, __fnv1a(noti), 0);
+	if (e) {
+		__seq_lock(&e->seq, 1);
+		e->state = REG_DELETED;
+		m.h->n_used--;
+		m.h->n_deleted++;
+		__seq_unlock(&e->seq);
+	}
+	__reg_unmap(&m);
 
-	return fd;
+	if (e == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
 }
 
-API int heynoti_get_pnoti_name(pid_t pid, const char *name, char *buf,
-			       int buf_size)
+API int heynoti_rebuild_registry(void)
 {
-	int ret;
+	struct reg_map old = { -1, 0, 0, NULL };
+	struct reg_map m = { -1, 0, 0, NULL };
+	int flags;
+	int n;
+
+	flags = REG_SCAN | REG_REPLACE;
+	if (__reg_lock(&old, 0) == -1) {
+		util_retvm_if(errno != ENOENT && errno != EINVAL, -1,
+			      "registry: lock: %s", strerror(errno));
+		/* a bad one is replaced, a missing one made */
+		if (errno == ENOENT)
+			flags = REG_SCAN;
+	}
 
-	if (!name)
-		return -1;
+	n = __reg_build(old.h ? &old : NULL, flags, &m);
+	__reg_unmap(&old);
+	util_retvm_if(n == -1, -1, "registry: rebuild: %s", strerror(errno));
 
-	ret = snprintf(buf, buf_size, ".%d_%s", pid, name);
+	n = m.h->n_used;
+	__reg_unmap(&m);
 
-	if (ret >= buf_size)
-		return -1;
-	else
-		return 0;
+	G_LOCK(reg);
+	reg_retry = 0;
+	G_UNLOCK(reg);
+
+	return n;
 }
 
 API int heynoti_get_snoti_name(const char *name, char *buf, int buf_size)
@@ -601,6 +5636,216 @@ gboolean gio_cb(GIOChannel *src, GIOCondition cond, gpointer data)
 	return TRUE;
 }
 
+static gboolean gio_timer_cb(GIOChannel *src, GIOCondition cond,
+			     gpointer data)
+{
+	__handle_timer(GPOINTER_TO_INT(data));
+
+	return TRUE;
+}
+
+/* the timer source rides on the inotify source and goes away with it */
+static int __attach_timer(struct noti_cont *nc)
+{
+	GSource *src;
+	GIOChannel *gio;
+
+	gio = g_io_channel_unix_new(nc->tfd);
+	util_retvm_if(gio == NULL, -1, "Error: create a new GIOChannel");
+
+	src = g_io_create_watch(gio, G_IO_IN);
+	g_source_set_callback(src, (GSourceFunc) gio_timer_cb,
+			      GINT_TO_POINTER(nc->fd), NULL);
+	g_source_add_child_source(nc->handler, src);
+	g_io_channel_unref(gio);
+	g_source_unref(src);
+
+	return 0;
+}
+
+static int __init_timer(struct noti_cont *nc)
+{
+	int tfd;
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	util_retvm_if(tfd == -1, -1, "timerfd create: %s", strerror(errno));
+
+	/* heynoti_poll_event may be polling in another thread */
+	g_atomic_int_set(&nc->tfd, tfd);
+
+	if (nc->ht == H_GLIB)
+		return __attach_timer(nc);
+
+	return 0;
+}
+
+static int __set_window(int fd, const char *noti, void (*cb) (void *),
+			int msec, int flag)
+{
+	char notipath[FILENAME_MAX];
+	struct noti_cont *nc;
+	struct noti_slot *t;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_ERR("Non-registered file descriptor : %d", fd);
+		errno = EBADF;
+		return -1;
+	}
+
+	if (noti == NULL || cb == NULL || msec < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+
+	g_mutex_lock(&nc->lock);
+
+	t = __find_slot(nc, noti, notipath, cb);
+	if (t == NULL) {
+		UTIL_ERR("Error: window [%s]: %s", noti, strerror(errno));
+		goto err;
+	}
+
+	/* a one-shot is delivered at once, nothing is held for it */
+	if (msec > 0 && (t->flags & NS_ONCE)) {
+		errno = ENOTSUP;
+		goto err;
+	}
+
+	if (msec > 0 && nc->tfd == -1 && __init_timer(nc) == -1)
+		goto err;
+
+	/* events already held are still delivered when their window ends */
+	g_atomic_int_and(&t->flags, ~NS_WINDOW);
+	g_atomic_int_set(&t->window, msec);
+	if (msec > 0)
+		g_atomic_int_or(&t->flags, flag);
+
+	g_mutex_unlock(&nc->lock);
+	return 0;
+
+ err:
+	g_mutex_unlock(&nc->lock);
+	return -1;
+}
+
+API int heynoti_set_throttle(int fd, const char *noti, void (*cb) (void *),
+			     int msec)
+{
+	return __set_window(fd, noti, cb, msec, NS_THROTTLE);
+}
+
+API int heynoti_set_debounce(int fd, const char *noti, void (*cb) (void *),
+			     int msec)
+{
+	return __set_window(fd, noti, cb, msec, NS_DEBOUNCE);
+}
+
+API int heynoti_set_dispatch(int fd, const char *noti, void (*cb) (void *),
+			     enum heynoti_dispatch mode)
+{
+	char notipath[FILENAME_MAX];
+	struct noti_cont *nc;
+	struct noti_slot *t;
+	struct noti_wd *w;
+
+	nc = __get_noti_cont(fd);
+	if (nc == NULL) {
+		UTIL_ERR("Non-registered file descriptor : %d", fd);
+		errno = EBADF;
+		return -1;
+	}
+
+	if (noti == NULL || cb == NULL ||
+	    (mode != HEYNOTI_DISPATCH_MAINLOOP &&
+	     mode != HEYNOTI_DISPATCH_POOL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	__make_noti_path(notipath, sizeof(notipath), noti);
+
+	g_mutex_lock(&nc->lock);
+
+	t = __find_slot(nc, noti, notipath, cb);
+	if (t == NULL) {
+		UTIL_ERR("Error: dispatch [%s]: %s", noti, strerror(errno));
+		goto err;
+	}
+
+	if (mode == HEYNOTI_DISPATCH_MAINLOOP) {
+		g_atomic_int_and(&t->flags, ~NS_POOL);
+		g_mutex_unlock(&nc->lock);
+		return 0;
+	}
+
+	/*
+	 * batch records and payload copies cannot outlive the dispatch, and
+	 * a one-shot is removed right after its callback returns
+	 */
+	if (t->flags & (NS_BATCH | NS_DATA | NS_ONCE)) {
+		errno = ENOTSUP;
+		goto err;
+	}
+
+	if (nc->pool == NULL) {
+		nc->pool = calloc(1, sizeof(struct noti_pool));
+		if (nc->pool == NULL) {
+			UTIL_ERR("Error: dispatch: %s", strerror(errno));
+			goto err;
+		}
+		g_mutex_init(&nc->pool->lock);
+		g_cond_init(&nc->pool->cond);
+		nc->pool->ref = 1;
+	}
+
+	if (t->q == NULL) {
+		w = __get_noti_wd(nc, t->wd);
+		if (w->q == NULL) {
+			w->q = calloc(1, sizeof(struct noti_queue));
+			if (w->q == NULL) {
+				UTIL_ERR("Error: dispatch: %s",
+					 strerror(errno));
+				goto err;
+			}
+			g_mutex_init(&w->q->lock);
+			g_queue_init(&w->q->jobs);
+			w->q->ref = 1;
+		}
+		t->q = __queue_ref(w->q);
+	}
+
+	/* t->q is set before dispatch can see the flag */
+	g_atomic_int_or(&t->flags, NS_POOL);
+
+	g_mutex_unlock(&nc->lock);
+	return 0;
+
+ err:
+	g_mutex_unlock(&nc->lock);
+	return -1;
+}
+
+API int heynoti_set_pool_threads(int threads)
+{
+	int r = 0;
+
+	if (threads <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	G_LOCK(pool);
+	pool_threads = threads;
+	if (pool && !g_thread_pool_set_max_threads(pool, threads, NULL))
+		r = -1;
+	G_UNLOCK(pool);
+
+	return r;
+}
+
 API int heynoti_attach_handler(int fd)
 {
 	int ret;
@@ -646,6 +5891,9 @@ API int heynoti_attach_handler(int fd)
 	nc->handler = src;
 	nc->ht = H_GLIB;
 
+	if (nc->tfd != -1)
+		__attach_timer(nc);
+
 	return 0;
 }
 
@@ -674,6 +5922,58 @@ API int heynoti_detach_handler(int fd)
 	return 0;
 }
 
+static void __free_noti_cont(struct noti_cont *nc)
+{
+	GHashTableIter iter;
+	gpointer val;
+	struct noti_wd *w;
+	struct noti_slot *t;
+	guint i;
+
+	/* the memory goes with the slabs, only the queue refs matter */
+	g_hash_table_iter_init(&iter, nc->wd_tbl);
+	while (g_hash_table_iter_next(&iter, NULL, &val)) {
+		w = val;
+		while ((t = w->ns) != NULL) {
+			w->ns = t->next;
+			__slot_unref(nc, t);
+		}
+		__queue_unref(w->q);
+	}
+	g_hash_table_destroy(nc->wd_tbl);
+	g_hash_table_destroy(nc->path_tbl);
+
+	for (i = 0; i < nc->pats->len; i++)
+		__slot_unref(nc, g_ptr_array_index(nc->pats, i));
+	g_ptr_array_free(nc->pats, TRUE);
+	__pat_free(nc->pat);
+	g_free(nc->roots);
+
+	for (i = 0; i < nc->timers->len; i++)
+		__slot_unref(nc, g_ptr_array_index(nc->timers, i));
+	g_ptr_array_free(nc->timers, TRUE);
+
+	__snap_free(nc->snap);
+	g_array_free(nc->dirty, TRUE);
+	__reclaim(nc);
+	__slab_destroy(&nc->slots);
+	__slab_destroy(&nc->wds);
+	g_string_chunk_free(nc->names);
+	g_mutex_clear(&nc->lock);
+
+	g_ptr_array_free(nc->pending, TRUE);
+	g_array_free(nc->events, TRUE);
+	g_ptr_array_free(nc->fired, TRUE);
+	__pool_close(nc->pool);
+	if (nc->tfd != -1)
+		close(nc->tfd);
+	nc->be->fini(nc);
+	close(nc->fd);
+
+	free(nc->buf);
+	free(nc);
+}
+
 API void heynoti_close(int fd)
 {
 	struct noti_cont *r = NULL;
@@ -685,12 +5985,20 @@ API void heynoti_close(int fd)
 		if (r->ht == H_GLIB)
 			heynoti_detach_handler(fd);
 
-		__clear_nslot_list(r->g_ns);
-		g_list_free(r->g_ns);
-		close(r->fd);
+		/* drop the fd from the table before it can be reused */
+		__set_noti_cont(fd, NULL);
+
+		/* no pool callback of fd is called after this returns */
+		__pool_close(r->pool);
+		r->pool = NULL;
+
+		/* closed from one of its callbacks, freed after dispatch */
+		if (r->dispatching) {
+			r->closing = 1;
+			return;
+		}
 
-		g_nc = g_list_remove(g_nc, (gconstpointer) r);
-		free(r);
+		__free_noti_cont(r);
 	}
 }
 
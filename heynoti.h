@@ -113,7 +113,13 @@ extern "C" {
  * If user want to initialize notify service, he(or she) can use this API.
  *
  * \par Important notes:
- * None
+ * With the shm backend, see heynoti_set_backend(), keys are signalled through
+ * a shared memory table and a futex instead of inotify. Publishing looks the
+ * key up in the key registry, else for its key file, without opening it, so a
+ * missing key fails as before. Inotify subscribers see the publish only with
+ * HEYNOTI_KEY_FILES=1 in the environment of the publisher. The table holds
+ * 4096 key names of up to 119 bytes; keys beyond it reach those inotify
+ * subscribers only. If the table cannot be mapped, inotify is used.
  *
  * \return Return Type (int) \n
  * - fd	- fild descriptor. \n
@@ -160,7 +166,9 @@ int heynoti_init(void);
  * If user want to finalize notify service, he(or she) can use this API.
  *
  * \par Important notes:
- * None
+ * May be called from a callback of fd; the remaining callbacks are then skipped.
+ * Must not be called while another thread dispatches or subscribes on fd.
+ * No callback of the worker pool, see heynoti_set_dispatch(), is called for fd after it returns: queued ones are dropped and running ones are waited for, except the one calling it. Their data may be freed then.
  *
  * \param fd	[in]	file descriptor that is created by calling heynoti_ini().
  *
@@ -204,7 +212,7 @@ void heynoti_close(int fd);
  * If user want to regist a new notification callback function with noti name, he(or she) can use this API.
  *
  * \par Important notes:
- * None
+ * May be called from any thread, including from a callback, while another thread dispatches.
  *
  * \param	fd	[in]	notify file descriptor created by heynoti_init()
  * \param	noti	[in]	notification name
@@ -264,7 +272,8 @@ int heynoti_subscribe(int fd, const char *noti, void (*cb)(void *), void *data);
  * If user want to unregist a notification callback function with noti name, he(or she) can use this API.
  *
  * \par Important notes:
- * None
+ * May be called from any thread, including from a callback.
+ * When called from a thread other than the dispatching one, a callback already being dispatched may still run once after this returns.
  * \pre heynoti_init()
  * \post None
  * \see heynoti_subscribe()
@@ -659,6 +668,1391 @@ int heynoti_get_snoti_name(const char *name, char *buf, int buf_size);
 /*================================================================================================*/
 int heynoti_get_pnoti_name(pid_t pid, const char *name, char *buf, int buf_size);
 
+/**
+ * \par Description:
+ * Set the size of the buffer used to read inotify events\n
+ * All pending events are drained with one read() into this buffer.\n
+ *
+ * \par Purpose:
+ * This API is used for tuning how many events are read by one system call.
+ *
+ * \par Typical use case:
+ * If a subscriber receives bursts of notifications, he(or she) can use this API to read a whole burst at once.
+ *
+ * \par Important notes:
+ * By default the buffer grows to the size of the pending queue reported by FIONREAD.\n
+ * A non-zero @p size fixes the buffer size and disables the FIONREAD query.\n
+ * The new size takes effect at the next read of events, so it may be called from a callback or another thread.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	size	[in]	buffer size in bytes, 0 to restore the default
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_get_event_count()
+ * \remark	None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	int fd;
+ *
+ *	if((fd = heynoti_init()) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_init fail, error_code: %d\n", fd);
+ *		return; //return if unavailable file descriptor is returned
+ *	}
+ *
+ *	if(heynoti_set_event_buffer(fd, 64 * 1024) < 0) //Read up to 64KB of events at once
+ *	{
+ *		fprintf(stderr, "heynoti_set_event_buffer fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_set_event_buffer(int fd, int size);
+
+/**
+ * \par Description:
+ * Get the number of events returned by the last read of the file descriptor
+ *
+ * \par Purpose:
+ * This API is used for measuring how well events are batched.
+ *
+ * \par Typical use case:
+ * If user want to know how many notifications were delivered by one read, he(or she) can use this API in a callback.
+ *
+ * \par Important notes:
+ * None
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ *
+ * \return Return Type (int) \n
+ * - 0 or positive number - the number of events. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_set_event_buffer()
+ * \remark	None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ * void callback(void *data)
+ * {
+ *	int fd = (int)data;
+ *
+ *	printf("%d events in this read\n", heynoti_get_event_count(fd));
+ * }
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_get_event_count(int fd);
+
+/**
+ * \par Description:
+ * Register a coalescing notification callback function with noti name\n
+ * All events of @p noti read in one batch are folded into a single callback call.\n
+ *
+ * \par Purpose:
+ * This API is used for receiving a burst of the same notification only once.
+ *
+ * \par Typical use case:
+ * If a notification is published repeatedly in a tight loop and user only need to know that it happened, he(or she) can use this API.
+ *
+ * \par Important notes:
+ * The callback is called after the whole batch is read, with the number of folded events in @p count.\n
+ * To unregister, pass the callback to heynoti_unsubscribe() cast to void (*)(void *).
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function pointer
+ * \param	data	[in]	callback function data
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_subscribe(), heynoti_unsubscribe()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ * void callback(void *data, int count)
+ * {
+ *	printf("test_testnoti was published %d times\n", count);
+ * }
+ * ...
+ *	if((heynoti_subscribe_coalesce(fd, "test_testnoti", callback, NULL))< 0)
+ *	{
+ *		fprintf(stderr, "heynoti_subscribe_coalesce fail\n");
+ *	}
+ * ...
+ *	heynoti_unsubscribe(fd, "test_testnoti", (void (*)(void *))callback);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_subscribe_coalesce(int fd, const char *noti, void (*cb)(void *data, int count), void *data);
+
+/**
+ * @brief A notification record delivered to a batch callback
+ */
+struct heynoti_event {
+	const char *noti;	/**< notification name */
+	uint32_t mask;		/**< union of the inotify event masks */
+	int count;		/**< number of events folded into this record */
+};
+
+/**
+ * \par Description:
+ * Register a batch notification callback function with noti name\n
+ * After each read of events, the callback is called once with a record for every key it watches that fired.\n
+ *
+ * \par Purpose:
+ * This API is used for receiving all notifications of one batch in a single call.
+ *
+ * \par Typical use case:
+ * If user feed notifications into his(or her) own queue, he(or she) can use this API to handle them together.
+ *
+ * \par Important notes:
+ * Subscriptions with the same callback and data are delivered together.\n
+ * The records are valid only until the callback returns.\n
+ * To unregister, pass the callback to heynoti_unsubscribe() cast to void (*)(void *).
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function pointer
+ * \param	data	[in]	callback function data
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_subscribe(), heynoti_unsubscribe()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ * void callback(const struct heynoti_event *ev, int n, void *data)
+ * {
+ *	int i;
+ *
+ *	for (i = 0; i < n; i++)
+ *		printf("%s: %d times\n", ev[i].noti, ev[i].count);
+ * }
+ * ...
+ *	heynoti_subscribe_batch(fd, "test_testnoti", callback, NULL);
+ *	heynoti_subscribe_batch(fd, "test_testnoti2", callback, NULL);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_subscribe_batch(int fd, const char *noti, void (*cb)(const struct heynoti_event *ev, int n, void *data), void *data);
+
+/**
+ * \par Description:
+ * Limit a subscription to at most one callback call per @p msec milliseconds\n
+ * The first event is delivered at once; further events within the window are held and delivered together when it ends.\n
+ *
+ * \par Purpose:
+ * This API is used for throttling a chatty notification.
+ *
+ * \par Typical use case:
+ * If user redraw the screen on a notification that is published very often, he(or she) can use this API.
+ *
+ * \par Important notes:
+ * The subscription is selected by @p noti and @p cb as in heynoti_unsubscribe().\n
+ * The window is measured with a timerfd which is served by heynoti_attach_handler() or heynoti_poll_event().\n
+ * A @p msec of 0 removes the throttle.\n
+ * Subscriptions made by heynoti_subscribe_once() can not have a window; errno is ENOTSUP.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function pointer of the subscription
+ * \param	msec	[in]	window in milliseconds
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_subscribe()
+ * \post None
+ * \see heynoti_set_debounce()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	heynoti_subscribe(fd, "test_testnoti", callback, NULL);
+ *
+ *	if(heynoti_set_throttle(fd, "test_testnoti", callback, 500) < 0) //At most twice a second
+ *	{
+ *		fprintf(stderr, "heynoti_set_throttle fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_set_throttle(int fd, const char *noti, void (*cb)(void *), int msec);
+
+/**
+ * \par Description:
+ * Deliver a subscription only after @p msec milliseconds without new events\n
+ * Every event restarts the window; the held events are delivered with one callback call when it ends.\n
+ *
+ * \par Purpose:
+ * This API is used for debouncing a chatty notification.
+ *
+ * \par Typical use case:
+ * If user want to react only once a burst of notifications has settled, he(or she) can use this API.
+ *
+ * \par Important notes:
+ * The subscription is selected by @p noti and @p cb as in heynoti_unsubscribe().\n
+ * The window is measured with a timerfd which is served by heynoti_attach_handler() or heynoti_poll_event().\n
+ * A @p msec of 0 removes the debounce.\n
+ * Subscriptions made by heynoti_subscribe_once() can not have a window; errno is ENOTSUP.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function pointer of the subscription
+ * \param	msec	[in]	window in milliseconds
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_subscribe()
+ * \post None
+ * \see heynoti_set_throttle()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	heynoti_subscribe(fd, "test_testnoti", callback, NULL);
+ *
+ *	if(heynoti_set_debounce(fd, "test_testnoti", callback, 300) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_set_debounce fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_set_debounce(int fd, const char *noti, void (*cb)(void *), int msec);
+
+/**
+ * @brief Where the callback of a subscription is called
+ */
+enum heynoti_dispatch {
+	HEYNOTI_DISPATCH_MAINLOOP = 0,	/**< in heynoti_poll_event() or the g_main_loop handler (default) */
+	HEYNOTI_DISPATCH_POOL,		/**< in a thread of the heynoti worker pool */
+};
+
+/**
+ * \par Description:
+ * Select where the callback of a subscription is called\n
+ * With HEYNOTI_DISPATCH_POOL, events are only decoded by the handler and the callback is queued to a bounded pool of worker threads.\n
+ *
+ * \par Purpose:
+ * This API is used for keeping a slow callback from delaying the other notifications.
+ *
+ * \par Typical use case:
+ * If a callback does blocking work, he(or she) can use this API to run it off the main loop.
+ *
+ * \par Important notes:
+ * Callbacks of the same notification name run one at a time, in the order of the events.\n
+ * Events already queued are still delivered after heynoti_unsubscribe(), but not after heynoti_close().\n
+ * At most 1024 callbacks of one notification name wait to be called. Later events are added to the last one for heynoti_subscribe_coalesce(), else dropped and logged.\n
+ * Subscriptions made by heynoti_subscribe_batch(), heynoti_subscribe_data() or heynoti_subscribe_once() can not use the worker pool; errno is ENOTSUP.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function pointer of the subscription
+ * \param	mode	[in]	HEYNOTI_DISPATCH_MAINLOOP or HEYNOTI_DISPATCH_POOL
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_subscribe()
+ * \post None
+ * \see heynoti_set_pool_threads()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	heynoti_subscribe(fd, "test_testnoti", callback, NULL);
+ *
+ *	if(heynoti_set_dispatch(fd, "test_testnoti", callback, HEYNOTI_DISPATCH_POOL) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_set_dispatch fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_set_dispatch(int fd, const char *noti, void (*cb)(void *), enum heynoti_dispatch mode);
+
+/**
+ * \par Description:
+ * Set the maximum number of threads of the heynoti worker pool
+ *
+ * \par Purpose:
+ * This API is used for bounding the threads used by HEYNOTI_DISPATCH_POOL subscriptions.
+ *
+ * \par Typical use case:
+ * If user want to change the number of worker threads(4 by default), he(or she) can use this API.
+ *
+ * \par Important notes:
+ * The pool is shared by all heynoti file descriptors of the process.
+ *
+ * \param	threads	[in]	maximum number of threads
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_set_dispatch()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	if(heynoti_set_pool_threads(2) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_set_pool_threads fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_set_pool_threads(int threads);
+
+/**
+ * \par Description:
+ * Register one notification callback function with many noti names at once\n
+ *
+ * \par Purpose:
+ * This API is used for subscribing a large set of noti names, for example at daemon startup.
+ *
+ * \par Typical use case:
+ * If user want to watch thousands of noti names with the same callback, he(or she) can use this API instead of calling heynoti_subscribe() for each name.
+ *
+ * \par Important notes:
+ * Each name is subscribed as with heynoti_subscribe(); a failure on one name does not stop the others.\n
+ * The new subscriptions become visible to the dispatcher together, when the call returns.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	names	[in]	array of notification names
+ * \param	n	[in]	number of names
+ * \param	cb	[in]	callback function pointer
+ * \param	data	[in]	callback function data
+ * \param	result	[out]	per-name status, 0 or an errno value (may be NULL)
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- number of names subscribed. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_subscribe(), heynoti_unsubscribe()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	const char *names[] = { "test_testnoti", "test_testnoti2" };
+ *	int result[2];
+ *
+ *	if(heynoti_subscribe_many(fd, names, 2, callback, NULL, result) < 2)
+ *	{
+ *		fprintf(stderr, "heynoti_subscribe_many: not all subscribed\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_subscribe_many(int fd, const char *const names[], int n, void (*cb)(void *), void *data, int *result);
+
+/**
+ * \par Description:
+ * Unregister every notification callback function registered with the given callback and data
+ *
+ * \par Purpose:
+ * This API is used for removing all subscriptions of one client at once.
+ *
+ * \par Typical use case:
+ * If user want to tear down a plugin that subscribed many noti names, he(or she) can use this API instead of calling heynoti_unsubscribe() for each name.
+ *
+ * \par Important notes:
+ * If cb is NULL, every subscription with the given data is removed, whatever its callback.\n
+ * The removals become visible to the dispatcher together, when the call returns.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	cb	[in]	callback function pointer, or NULL
+ * \param	data	[in]	callback function data
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- number of subscriptions removed. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_unsubscribe(), heynoti_unsubscribe_prefix()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	heynoti_subscribe(fd, "test_testnoti", callback, plugin);
+ *	heynoti_subscribe(fd, "test_testnoti2", callback, plugin);
+ * ...
+ *	heynoti_unsubscribe_all(fd, callback, plugin);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_unsubscribe_all(int fd, void (*cb)(void *), void *data);
+
+/**
+ * \par Description:
+ * Unregister every notification callback function whose noti name starts with the given prefix
+ *
+ * \par Purpose:
+ * This API is used for removing the subscriptions of a family of noti names at once.
+ *
+ * \par Typical use case:
+ * If user name his(or her) notifications with a common prefix, he(or she) can use this API to drop them together.
+ *
+ * \par Important notes:
+ * The prefix is matched against the names passed when subscribing.\n
+ * Subscriptions made by heynoti_subscribe_pattern() are not removed, whatever their pattern; use heynoti_unsubscribe_pattern().\n
+ * The removals become visible to the dispatcher together, when the call returns.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	prefix	[in]	noti name prefix
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- number of subscriptions removed. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_unsubscribe(), heynoti_unsubscribe_all()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	heynoti_unsubscribe_prefix(fd, "test_");
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_unsubscribe_prefix(int fd, const char *prefix);
+
+/**
+ * \par Description:
+ * Register a new notification callback function with noti name and return its subscription id\n
+ *
+ * \par Purpose:
+ * This API is used for registering a notification callback function that is later removed by id.
+ *
+ * \par Typical use case:
+ * If user want to register the same callback several times with different data, or to unsubscribe without keeping the noti name, he(or she) can use this API.
+ *
+ * \par Important notes:
+ * Unlike heynoti_subscribe(), the same callback may be registered more than once for a noti name.\n
+ * An id is valid until it is unsubscribed; ids of removed subscriptions are not reused for a long time.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function pointer
+ * \param	data	[in]	callback function data
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- subscription id. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_unsubscribe_id()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	int id;
+ *
+ *	if((id = heynoti_subscribe_id(fd, "test_testnoti", callback, item)) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_subscribe_id fail\n");
+ *	}
+ * ...
+ *	heynoti_unsubscribe_id(fd, id);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_subscribe_id(int fd, const char *noti, void (*cb)(void *), void *data);
+
+/**
+ * \par Description:
+ * Unregister the notification callback function registered with the given subscription id
+ *
+ * \par Purpose:
+ * This API is used for unregistering a subscription made by heynoti_subscribe_id().
+ *
+ * \par Typical use case:
+ * If user want to unregister a subscription by the id returned from heynoti_subscribe_id(), he(or she) can use this API.
+ *
+ * \par Important notes:
+ * May be called from any thread, including from a callback.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	id	[in]	subscription id returned by heynoti_subscribe_id()
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_subscribe_id()
+ * \post None
+ * \see heynoti_subscribe_id()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	if(heynoti_unsubscribe_id(fd, id) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_unsubscribe_id fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_unsubscribe_id(int fd, int id);
+
+/**
+ * \par Description:
+ * Register a notification callback function that is called only for the first occurrence of the noti
+ *
+ * \par Purpose:
+ * This API is used for waiting on a notification once, such as a boot completed signal.
+ *
+ * \par Typical use case:
+ * If user want to be notified of the first event only, without unsubscribing from the callback, he(or she) can use this API.
+ *
+ * \par Important notes:
+ * The subscription is removed by the library right after the callback returns; no more events of the noti are read for it.\n
+ * When it is the only subscription of the noti, the kernel drops the watch by itself (IN_ONESHOT).\n
+ * It may still be removed with heynoti_unsubscribe() before it fires.\n
+ * heynoti_set_throttle(), heynoti_set_debounce() and the worker pool of heynoti_set_dispatch() do not apply to it, and fail with ENOTSUP.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init()
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function pointer
+ * \param	data	[in]	callback function data
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_subscribe(), heynoti_unsubscribe()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	if(heynoti_subscribe_once(fd, "boot_completed", callback, NULL) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_subscribe_once fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_subscribe_once(int fd, const char *noti, void (*cb)(void *), void *data);
+
+/**
+ * \par Description:
+ * Initialize the notify service in directory mode\n
+ * Get file descriptor associated with a new inotify event queue that watches the noti root directory only.\n
+ *
+ * \par Purpose:
+ * This API is used for initializing notify service for processes that subscribe to many notifications.
+ *
+ * \par Typical use case:
+ * If user want to subscribe to thousands of notis without one inotify watch per noti, he(or she) can use this API instead of heynoti_init().
+ *
+ * \par Important notes:
+ * The returned fd is used with the same APIs as the one from heynoti_init().\n
+ * Subscribing costs no inotify watch, so it is not limited by fs.inotify.max_user_watches; every write in the noti root wakes the process up, though.\n
+ * Only notis directly in the noti root can be subscribed, and deleting a noti file is delivered as an event.\n
+ * A noti file need not exist at subscription time.
+ *
+ * \return Return Type (int) \n
+ * - fd	- fild descriptor. \n
+ * - -1	- fail to create file descriptor. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_init(), heynoti_close()
+ * \remark	None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	int fd = heynoti_init_dir();
+ *
+ *	if (fd < 0) {
+ *		printf("heynoti_init_dir() failed\n");
+ *		return;
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_init_dir(void);
+
+/**
+ * \par Description:
+ * Register a notification callback function for every noti whose name matches a glob pattern
+ *
+ * \par Purpose:
+ * This API is used for subscribing to a family of notis, such as the ones made by heynoti_get_snoti_name() or heynoti_get_pnoti_name(), without subscribing to each of them.
+ *
+ * \par Typical use case:
+ * If user want to be notified of all ".SYS_net_*" notis, he(or she) can use this API with "*.SYS_net_*".
+ *
+ * \par Important notes:
+ * '*' matches any string, including an empty one or a leading '.', and '?' matches any one character; other characters match themselves.\n
+ * Patterns are matched against the names of the files directly in the noti root, which is watched as a whole while there are patterns; a pattern with '/' is rejected.\n
+ * The callback gets the name of the noti that fired. A noti matching several patterns calls each of them.\n
+ * Matching cost does not grow with the number of patterns, and a name seen before is matched from a cache.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init() or heynoti_init_dir()
+ * \param	pattern	[in]	glob pattern of noti names
+ * \param	cb	[in]	callback function pointer, called with the noti name and data
+ * \param	data	[in]	callback function data
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init()
+ * \post None
+ * \see heynoti_unsubscribe_pattern()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ * void net_callback(const char *noti, void *data)
+ * {
+ *	printf("%s fired\n", noti);
+ * }
+ * ...
+ *	if(heynoti_subscribe_pattern(fd, "*.SYS_net_*", net_callback, NULL) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_subscribe_pattern fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_subscribe_pattern(int fd, const char *pattern, void (*cb)(const char *noti, void *data), void *data);
+
+/**
+ * \par Description:
+ * Unregister a notification callback function registered with a glob pattern
+ *
+ * \par Purpose:
+ * This API is used for unregistering a subscription made by heynoti_subscribe_pattern().
+ *
+ * \par Typical use case:
+ * If user want to stop receiving the notis of a pattern, he(or she) can use this API.
+ *
+ * \par Important notes:
+ * The pattern must be the same string given to heynoti_subscribe_pattern(). A NULL cb removes every callback of the pattern.\n
+ * The noti root watch goes away with the last pattern.
+ *
+ * \param	fd	[in]	notify file descriptor created by heynoti_init() or heynoti_init_dir()
+ * \param	pattern	[in]	glob pattern of noti names
+ * \param	cb	[in]	callback function pointer
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_subscribe_pattern()
+ * \post None
+ * \see heynoti_subscribe_pattern()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	heynoti_unsubscribe_pattern(fd, "*.SYS_net_*", net_callback);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_unsubscribe_pattern(int fd, const char *pattern, void (*cb)(const char *noti, void *data));
+
+/**
+ * \par Description:
+ * Get the file path of a noti\n
+ *
+ * \par Purpose:
+ * This API is used for getting the path of the file backing a noti, in the flat or the sharded layout of the noti root.
+ *
+ * \par Typical use case:
+ * If user want to create, change the permission of or remove a noti file, like heynotitool does, he(or she) can use this API.
+ *
+ * \par Important notes:
+ * In the sharded layout, the path is in a subdirectory of the noti root picked by a hash of the name.
+ *
+ * \param	name	[in]	noti name
+ * \param	buf	[out]	buffer for the path
+ * \param	buf_size	[in]	size of buffer
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * Tools.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_migrate_sharded()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	char path[PATH_MAX];
+ *
+ *	if(heynoti_get_noti_path("test_testnoti", path, sizeof(path)) == 0)
+ *		creat(path, 0644);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_get_noti_path(const char *name, char *buf, int buf_size);
+
+/**
+ * \par Description:
+ * Switch the noti root to the sharded layout\n
+ *
+ * \par Purpose:
+ * This API is used for spreading the noti files over hashed subdirectories of the noti root, so that lookups and publishes stay cheap with a very large number of notis.
+ *
+ * \par Typical use case:
+ * It is called once by "heynotitool migrate", as root.
+ *
+ * \par Important notes:
+ * It makes the shard directories and the marker file that turns the layout on, then moves every flat noti file into its shard. It may be run again to finish an interrupted migration.\n
+ * Moved files keep their inode, so subscriptions made before keep working; processes that looked up the flat layout before still find the moved files.\n
+ * Contexts made by heynoti_init_dir() before the migration only see the notis left in the noti root; they should be made again.
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- number of noti files moved. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * Tools.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_get_noti_path()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	if(heynoti_migrate_sharded() < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_migrate_sharded fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_migrate_sharded(void);
+
+/**
+ * \par Description:
+ * Remove the noti files of processes that are gone\n
+ *
+ * \par Purpose:
+ * This API is used for deleting the stale per process noti files named by heynoti_get_pnoti_name(), which are never removed by their owners.
+ *
+ * \par Typical use case:
+ * It is called from time to time by "heynotitool gc", or by a system daemon, to keep the noti root small.
+ *
+ * \par Important notes:
+ * A ".<pid>_<name>" file is removed when pid does not exist, or when the process using pid started after the file was last changed, so the pid was reused.\n
+ * It is safe to run while notis are published: a file made again by a process reusing the pid is kept. Publishing to a removed noti fails as for any missing noti.
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- number of files removed. \n
+ *
+ * \par Prospective clients:
+ * Tools.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_get_pnoti_name()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	printf("%d stale notis removed\n", heynoti_gc_pnoti());
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_gc_pnoti(void);
+
+/**
+ * @brief Registry record of a noti key
+ */
+struct heynoti_key_info {
+	unsigned int mode;	/**< permission bits of the noti file */
+	long long created;	/**< registration time, usec since the epoch */
+	long long published;	/**< last heynoti_publish() time, usec since the epoch, or 0 */
+};
+
+/**
+ * \par Description:
+ * Look up a noti key in the key registry\n
+ *
+ * \par Purpose:
+ * This API is used for checking that a key exists, and when it was last published, without touching the noti root.
+ *
+ * \par Typical use case:
+ * Monitors and tools that show the state of keys, and publishers that want to know a key exists before publishing.
+ *
+ * \par Important notes:
+ * The registry is a file of the noti root shared by all processes; a lookup takes no lock and makes no system call once the registry is mapped.\n
+ * It is kept by heynotitool set/unset and heynoti_register_key(); keys made otherwise are only seen after heynoti_rebuild_registry().\n
+ * The publish time is stamped by heynoti_publish() of the key by name.
+ *
+ * \param	noti	[in]	noti name
+ * \param	info	[out]	the record of the key
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail: errno is ENOENT if the key is not registered, ENODATA if there is no registry. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_foreach_key(), heynoti_register_key()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	struct heynoti_key_info info;
+ *
+ *	if(heynoti_get_key_info("test_testnoti", &info) == 0)
+ *		printf("last published at %lld\n", info.published);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_get_key_info(const char *noti, struct heynoti_key_info *info);
+
+/**
+ * \par Description:
+ * Call a function for every key of the key registry\n
+ *
+ * \par Purpose:
+ * This API is used for listing the noti keys without reading the noti root directory.
+ *
+ * \par Typical use case:
+ * Tools that dump all keys with their permissions and publish times.
+ *
+ * \par Important notes:
+ * The keys are copied out of the registry first, so @p cb may call other heynoti APIs. Returning non zero from @p cb stops the walk.
+ *
+ * \param	cb	[in]	function called with the name and record of each key
+ * \param	data	[in]	user data passed to cb
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- number of keys cb was called for. \n
+ * - -1	- fail: errno is ENODATA if there is no registry. \n
+ *
+ * \par Prospective clients:
+ * Tools.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_get_key_info()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ * int print_key(const char *noti, const struct heynoti_key_info *info, void *data)
+ * {
+ *	printf("%s %o\n", noti, info->mode);
+ *	return 0;
+ * }
+ * ...
+ *	heynoti_foreach_key(print_key, NULL);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_foreach_key(int (*cb)(const char *noti, const struct heynoti_key_info *info, void *data), void *data);
+
+/**
+ * \par Description:
+ * Add a noti key to the key registry, or set its mode\n
+ *
+ * \par Purpose:
+ * This API is used for making a key known to heynoti_get_key_info() and heynoti_foreach_key().
+ *
+ * \par Typical use case:
+ * It is called by "heynotitool set" after making the noti file.
+ *
+ * \par Important notes:
+ * The registry is made from the noti files of the noti root if it does not exist yet.\n
+ * Names longer than 95 bytes are not registered.
+ *
+ * \param	noti	[in]	noti name
+ * \param	mode	[in]	permission bits of the noti file
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * Tools.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_unregister_key(), heynoti_rebuild_registry()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	if(heynoti_register_key("test_testnoti", 0644) < 0)
+ *	{
+ *		fprintf(stderr, "heynoti_register_key fail\n");
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_register_key(const char *noti, mode_t mode);
+
+/**
+ * \par Description:
+ * Remove a noti key from the key registry\n
+ *
+ * \par Purpose:
+ * This API is used for dropping a key whose noti file was removed.
+ *
+ * \par Typical use case:
+ * It is called by "heynotitool unset" after removing the noti file.
+ *
+ * \par Important notes:
+ * The payload of heynoti_publish_data() for the key is removed as well.
+ *
+ * \param	noti	[in]	noti name
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail: errno is ENOENT if the key is not registered. \n
+ *
+ * \par Prospective clients:
+ * Tools.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_register_key()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	heynoti_unregister_key("test_testnoti");
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_unregister_key(const char *noti);
+
+/**
+ * \par Description:
+ * Make the key registry again from the noti files\n
+ *
+ * \par Purpose:
+ * This API is used for bringing the registry in line with the noti root, or for making it the first time.
+ *
+ * \par Typical use case:
+ * It is called by "heynotitool registry" after keys were made or removed by hand, or when the registry file is damaged.
+ *
+ * \par Important notes:
+ * Keys already registered keep their times; the others are dated from the modification time of their file.\n
+ * The new registry replaces the old one at once; processes mapping the old one move to the new one on their next lookup.
+ *
+ * \return Return Type (int) \n
+ * - >= 0	- number of keys registered. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * Tools.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_register_key()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	printf("%d keys\n", heynoti_rebuild_registry());
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_rebuild_registry(void);
+
+/**
+ * @brief Largest payload of heynoti_publish_data(), in bytes
+ */
+#define HEYNOTI_PAYLOAD_MAX	4080
+
+/**
+ * \par Description:
+ * Send a notification carrying a small payload\n
+ *
+ * \par Purpose:
+ * This API is used for passing what changed along with the notification, so that subscribers need no other IPC to learn it.
+ *
+ * \par Typical use case:
+ * A service publishes the new value of a setting; subscribers of heynoti_subscribe_data() get it in their callback.
+ *
+ * \par Important notes:
+ * The noti file must exist. The payload is written into a payload file of the library next to it, which is grown to a page on the first call and never shrunk. Only the last payload is kept; subscribers see the one current when their callback runs.\n
+ * Writes are guarded by a sequence counter, so readers never see a partly written payload. Subscribers of heynoti_subscribe() get a plain notification.
+ *
+ * \param	noti	[in]	notification name
+ * \param	buf	[in]	payload
+ * \param	len	[in]	length of the payload, at most HEYNOTI_PAYLOAD_MAX
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_subscribe_data(), heynoti_publish()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	int level = 42;
+ *
+ *	if(heynoti_publish_data("test_testnoti", &level, sizeof(level)))
+ *		fprintf(stderr, "heynoti_publish_data fail\n");
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_publish_data(const char *noti, const void *buf, int len);
+
+/**
+ * \par Description:
+ * Register a callback function that receives the payload of a noti\n
+ *
+ * \par Purpose:
+ * This API is used for receiving the payload of heynoti_publish_data() with the notification.
+ *
+ * \par Typical use case:
+ * A client that needs the new value of what changed, instead of reading it back through another IPC.
+ *
+ * \par Important notes:
+ * The payload file is mapped on the first event, so reading the payload takes no system call. @p buf is a copy valid during the callback only.\n
+ * @p buf is NULL and @p len 0 when no payload was published yet, and on deletion of the noti file.\n
+ * It is removed by heynoti_unsubscribe() with @p cb cast to void (*)(void *). It may be throttled or debounced, but not dispatched to the worker pool.
+ *
+ * \param	fd	[in]	file descriptor of heynoti
+ * \param	noti	[in]	notification name
+ * \param	cb	[in]	callback function, called with the payload
+ * \param	data	[in]	user data passed to cb
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre heynoti_init() should be called before.
+ * \post None
+ * \see heynoti_publish_data(), heynoti_unsubscribe()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ * void callback(const void *buf, int len, void *data)
+ * {
+ *	if (len == sizeof(int))
+ *		printf("level %d\n", *(const int *)buf);
+ * }
+ * ...
+ *	heynoti_subscribe_data(fd, "test_testnoti", callback, NULL);
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_subscribe_data(int fd, const char *noti, void (*cb)(const void *buf, int len, void *data), void *data);
+
+/**
+ * \par Description:
+ * Select the backend carrying the notifications of this process\n
+ *
+ * \par Purpose:
+ * This API is used for choosing how keys are signalled, e.g. to compare transports with the same clients.
+ *
+ * \par Typical use case:
+ * A benchmark running the same test once with "inotify" and once with "shm".
+ *
+ * \par Important notes:
+ * Without this call the backend is named by HEYNOTI_BACKEND in the environment, else by the HEYNOTI_BACKEND build option, "inotify" by default. A backend that cannot be used there falls back to "inotify".\n
+ * The backend applies to the contexts made and the notis published afterwards. Contexts made before keep theirs.\n
+ * Publishes of "shm" and "broker" do not open the key file, unless HEYNOTI_KEY_FILES=1 is set in the environment of the publisher; only then do subscribers of "inotify" and "uring" see them. Subscribers of "shm" and "broker" see those of their own backend only.\n
+ * Available backends: "inotify", key files watched with inotify; "uring", the same with publishes and event reads through io_uring, one system call each, on kernels 5.15 and later; "shm", a shared memory table in the noti root and a futex; "broker", datagrams fanned out by the heynotid daemon, which must be running.\n
+ * A key must exist to publish it with any backend; "shm" and "broker" find it in the key registry, see heynoti_register_key(), else by its key file. Contexts of "broker" subscribe again when heynotid restarts; publishes while it is down are lost, except to the subscribers of the key files with HEYNOTI_KEY_FILES=1.
+ *
+ * \param	name	[in]	backend name
+ *
+ * \return Return Type (int) \n
+ * - 0	- success. \n
+ * - -1	- fail, errno EINVAL for an unknown name, or the error setting the backend up. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_get_backend(), heynoti_init()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	if (heynoti_set_backend("shm") < 0)
+ *		printf("shm backend unavailable, keeping %s\n", heynoti_get_backend());
+ *
+ *	fd = heynoti_init();
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_set_backend(const char *name);
+
+/**
+ * \par Description:
+ * Get the name of the backend of this process\n
+ *
+ * \par Purpose:
+ * This API is used for finding out which transport carries the notifications.
+ *
+ * \par Typical use case:
+ * Reporting the backend a fallback ended up with.
+ *
+ * \par Important notes:
+ * The first call looks the backend up as heynoti_init() would.
+ *
+ * \return Return Type (const char *) \n
+ * - backend name, "inotify", "uring", "shm" or "broker". \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_set_backend()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	printf("heynoti backend: %s\n", heynoti_get_backend());
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+const char *heynoti_get_backend(void);
+
+/**
+ * \par Description:
+ * Send the notifications of several keys at once\n
+ *
+ * \par Purpose:
+ * This API is used for sending many notifications with fewer system calls than one heynoti_publish() each.
+ *
+ * \par Typical use case:
+ * A service whose state change concerns several keys publishes them together.
+ *
+ * \par Important notes:
+ * Key paths are made from a descriptor of the noti root kept open by the library.
+ * The backend issues the publishes back to back: as one io_uring submission, one sendmmsg() to heynotid,
+ * or plain openat() calls. A key that fails does not stop the others.
+ *
+ * \param	names	[in]	notification names or paths
+ * \param	n	[in]	number of names
+ * \param	results	[out]	errno of each key, 0 if it was published, may be NULL
+ *
+ * \return Return Type (int) \n
+ * - number of keys published. \n
+ * - -1	- fail: names is NULL or holds NULL, or n is negative. \n
+ *
+ * \par Prospective clients:
+ * External Apps.
+ *
+ * \pre None
+ * \post None
+ * \see heynoti_publish()
+ * \remark  None
+ * \par Sample code:
+ * \code
+ * ...
+ * #include <heynoti.h>
+ * ...
+ *	const char *keys[] = { "test_battery", "test_charger", "test_usb" };
+ *	int err[3];
+ *	int i;
+ *
+ *	if (heynoti_publish_many(keys, 3, err) < 3) {
+ *		for (i = 0; i < 3; i++)
+ *			if (err[i])
+ *				fprintf(stderr, "%s: %s\n", keys[i], strerror(err[i]));
+ *	}
+ * ...
+ * \endcode
+ */
+/*================================================================================================*/
+int heynoti_publish_many(const char *const names[], int n, int *results);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,472 @@
+/*
+ * heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <glib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "heynoti-broker.h"
+
+#ifndef NOTI_ROOT
+#  define NOTI_ROOT "/opt/share/noti"
+#endif
+
+#define BATCH		64	/* datagrams read at once */
+#define OUT_MAX		256	/* datagrams sent at once */
+#define RCVBUF_SIZE	(1 << 20)
+
+struct client {
+	char *name;		/* key of clients */
+	struct sockaddr_un addr;
+	socklen_t len;
+	GHashTable *keys;	/* subscribed keys */
+	int all;		/* subscribed every key */
+	int dead;		/* its socket is gone */
+};
+
+static char *root = NOTI_ROOT;
+
+static GHashTable *clients;	/* address -> client */
+static GHashTable *subs;	/* key -> GPtrArray of clients */
+static GPtrArray *all;		/* clients of every key */
+static int n_dead;
+
+static struct mmsghdr out[OUT_MAX];
+static struct iovec out_iov[OUT_MAX];
+static struct client *out_to[OUT_MAX];
+
+static unsigned long n_pub;
+static unsigned long n_coalesced;
+static unsigned long n_sent;
+static unsigned long n_drop;
+
+static volatile sig_atomic_t quit;
+static volatile sig_atomic_t dump;
+
+
+static GOptionEntry entries[] = {
+	{"root", 'r', 0, G_OPTION_ARG_STRING, &root,
+	"noti root to serve", "DIR"},
+	{NULL}
+};
+
+
+static void __on_signal(int sig)
+{
+	if (sig == SIGUSR1)
+		dump = 1;
+	else
+		quit = 1;
+}
+
+static void __dump(void)
+{
+	fprintf(stderr, "published %lu coalesced %lu sent %lu dropped %lu "
+		"clients %u keys %u\n", n_pub, n_coalesced, n_sent, n_drop,
+		g_hash_table_size(clients), g_hash_table_size(subs));
+}
+
+static void __unsub(struct client *c, int key)
+{
+	GPtrArray *a;
+
+	if (!g_hash_table_remove(c->keys, GINT_TO_POINTER(key)))
+		return;
+
+	a = g_hash_table_lookup(subs, GINT_TO_POINTER(key));
+	if (a == NULL)
+		return;
+	g_ptr_array_remove_fast(a, c);
+	if (a->len == 0)
+		g_hash_table_remove(subs, GINT_TO_POINTER(key));
+}
+
+static void __sub(struct client *c, int key)
+{
+	GPtrArray *a;
+
+	if (g_hash_table_lookup(c->keys, GINT_TO_POINTER(key)))
+		return;
+	g_hash_table_insert(c->keys, GINT_TO_POINTER(key), c);
+
+	a = g_hash_table_lookup(subs, GINT_TO_POINTER(key));
+	if (a == NULL) {
+		a = g_ptr_array_new();
+		g_hash_table_insert(subs, GINT_TO_POINTER(key), a);
+	}
+	g_ptr_array_add(a, c);
+}
+
+static void __sub_all(struct client *c, int on)
+{
+	if (c->all == on)
+		return;
+
+	c->all = on;
+	if (on)
+		g_ptr_array_add(all, c);
+	else
+		g_ptr_array_remove_fast(all, c);
+}
+
+static gboolean __unsub_key(gpointer key, gpointer value, gpointer data)
+{
+	GPtrArray *a;
+
+	a = g_hash_table_lookup(subs, key);
+	if (a) {
+		g_ptr_array_remove_fast(a, data);
+		if (a->len == 0)
+			g_hash_table_remove(subs, key);
+	}
+
+	return TRUE;
+}
+
+static void __client_free(gpointer p)
+{
+	struct client *c = p;
+
+	g_hash_table_foreach_remove(c->keys, __unsub_key, c);
+	g_hash_table_destroy(c->keys);
+	__sub_all(c, 0);
+	g_free(c);
+}
+
+/* the client of a bound socket, made for a subscription */
+static struct client *__client_get(struct sockaddr_un *sa, socklen_t len,
+				   int create)
+{
+	struct client *c;
+	char *name;
+	size_t n;
+
+	/* publishers need no address of their own */
+	if (len <= offsetof(struct sockaddr_un, sun_path) + 1)
+		return NULL;
+
+	/* abstract addresses start with a NUL */
+	n = len - offsetof(struct sockaddr_un, sun_path);
+	if (sa->sun_path[0] == '\0')
+		name = g_strndup(sa->sun_path + 1, n - 1);
+	else
+		name = g_strndup(sa->sun_path, n);
+
+	c = g_hash_table_lookup(clients, name);
+	if (c || !create) {
+		g_free(name);
+		return c;
+	}
+
+	c = g_new0(struct client, 1);
+	c->name = name;
+	memcpy(&c->addr, sa, len);
+	c->len = len;
+	c->keys = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_hash_table_insert(clients, name, c);
+
+	return c;
+}
+
+static gboolean __is_dead(gpointer key, gpointer value, gpointer data)
+{
+	return ((struct client *)value)->dead;
+}
+
+static void __flush(int fd, int n)
+{
+	int i;
+	int r;
+
+	for (i = 0; i < n;) {
+		r = sendmmsg(fd, out + i, n - i, MSG_DONTWAIT);
+		if (r > 0) {
+			n_sent += r;
+			i += r;
+			continue;
+		}
+		if (r == -1 && errno == EINTR)
+			continue;
+
+		/* a full queue loses the event, a closed socket its client */
+		n_drop++;
+		if (errno != EAGAIN && errno != ENOBUFS && !out_to[i]->dead) {
+			out_to[i]->dead = 1;
+			n_dead++;
+		}
+		i++;
+	}
+}
+
+static int __queue(int fd, int n, struct client *c, struct broker_msg *m,
+		   unsigned int len)
+{
+	if (c->dead)
+		return n;
+
+	out_iov[n].iov_base = m;
+	out_iov[n].iov_len = len;
+	out[n].msg_hdr.msg_name = &c->addr;
+	out[n].msg_hdr.msg_namelen = c->len;
+	out[n].msg_hdr.msg_iov = &out_iov[n];
+	out[n].msg_hdr.msg_iovlen = 1;
+	out_to[n] = c;
+
+	if (++n == OUT_MAX) {
+		__flush(fd, n);
+		n = 0;
+	}
+
+	return n;
+}
+
+/* sends the publishes of a batch on to their subscribers */
+static void __fanout(int fd, struct mmsghdr *mm, int *pub, int n_pub_batch)
+{
+	struct broker_msg *m;
+	struct client *c;
+	GPtrArray *a;
+	unsigned int len;
+	guint j;
+	int n;
+	int i;
+
+	n = 0;
+	for (i = 0; i < n_pub_batch; i++) {
+		m = mm[pub[i]].msg_hdr.msg_iov->iov_base;
+		len = mm[pub[i]].msg_len;
+
+		a = g_hash_table_lookup(subs, GINT_TO_POINTER(m->key));
+		for (j = 0; a && j < a->len; j++) {
+			c = g_ptr_array_index(a, j);
+			/* it gets the event through all */
+			if (!c->all)
+				n = __queue(fd, n, c, m, len);
+		}
+		for (j = 0; j < all->len; j++)
+			n = __queue(fd, n, g_ptr_array_index(all, j), m, len);
+	}
+	if (n > 0)
+		__flush(fd, n);
+
+	if (n_dead > 0) {
+		g_hash_table_foreach_remove(clients, __is_dead, NULL);
+		n_dead = 0;
+	}
+}
+
+static void __serve(int fd)
+{
+	static struct broker_msg msg[BATCH];
+	static struct sockaddr_un addr[BATCH];
+	static struct iovec iov[BATCH];
+	static struct mmsghdr mm[BATCH];
+	GHashTable *seen;
+	struct broker_msg *m;
+	struct client *c;
+	int pub[BATCH];
+	int n_pub_batch;
+	int n;
+	int i;
+
+	for (i = 0; i < BATCH; i++) {
+		iov[i].iov_base = &msg[i];
+		iov[i].iov_len = sizeof(msg[i]);
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+		mm[i].msg_hdr.msg_name = &addr[i];
+	}
+	seen = g_hash_table_new(g_str_hash, g_str_equal);
+
+	while (!quit) {
+		if (dump) {
+			dump = 0;
+			__dump();
+		}
+
+		for (i = 0; i < BATCH; i++)
+			mm[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+
+		n = recvmmsg(fd, mm, BATCH, MSG_WAITFORONE, NULL);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Error!\t recvmmsg: %s\n",
+				strerror(errno));
+			break;
+		}
+
+		/* a key published twice in a batch fires once, as inotify
+		 * coalesces repeated events */
+		n_pub_batch = 0;
+		for (i = 0; i < n; i++) {
+			m = &msg[i];
+			if (mm[i].msg_len < BROKER_MSG_MIN)
+				continue;
+
+			if (m->op == BROKER_PUB) {
+				if (mm[i].msg_len <= BROKER_MSG_MIN)
+					continue;
+				m->name[mm[i].msg_len - BROKER_MSG_MIN - 1] =
+				    '\0';
+				n_pub++;
+				if (g_hash_table_lookup(seen, m->name)) {
+					n_coalesced++;
+					continue;
+				}
+				g_hash_table_insert(seen, m->name, m);
+				pub[n_pub_batch++] = i;
+				continue;
+			}
+
+			c = __client_get(&addr[i], mm[i].msg_hdr.msg_namelen,
+					 m->op == BROKER_SUB ||
+					 m->op == BROKER_SUB_ALL);
+			if (c == NULL)
+				continue;
+
+			switch (m->op) {
+			case BROKER_SUB:
+				__sub(c, m->key);
+				break;
+			case BROKER_UNSUB:
+				__unsub(c, m->key);
+				break;
+			case BROKER_SUB_ALL:
+				__sub_all(c, 1);
+				break;
+			case BROKER_UNSUB_ALL:
+				__sub_all(c, 0);
+				break;
+			case BROKER_BYE:
+				g_hash_table_remove(clients, c->name);
+				break;
+			}
+		}
+
+		__fanout(fd, mm, pub, n_pub_batch);
+		g_hash_table_remove_all(seen);
+	}
+
+	g_hash_table_destroy(seen);
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_un sa;
+	struct sockaddr_un tmp;
+	struct sigaction act;
+	int size = RCVBUF_SIZE;
+	int fd;
+
+	GError *error = NULL;
+	GOptionContext *context;
+
+	context = g_option_context_new("- heynoti broker");
+	g_option_context_add_main_entries(context, entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_print("option parsing failed: %s\n", error->message);
+		exit(1);
+	}
+	g_option_context_free(context);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	if (snprintf(sa.sun_path, sizeof(sa.sun_path), "%s/%s", root,
+		     BROKER_SOCK) >= (int)sizeof(sa.sun_path)) {
+		fprintf(stderr, "Error!\t %s: path too long\n", root);
+		return 1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		fprintf(stderr, "Error!\t socket: %s\n", strerror(errno));
+		return 1;
+	}
+
+	/* a socket file taking connections belongs to a running broker */
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0) {
+		fprintf(stderr, "Error!\t %s: already served\n", sa.sun_path);
+		return 1;
+	}
+
+	/*
+	 * Made under another name and renamed in place once usable:
+	 * contexts of a previous broker see the rename and subscribe again.
+	 */
+	tmp = sa;
+	if (snprintf(tmp.sun_path, sizeof(tmp.sun_path), "%s.%d", sa.sun_path,
+		     getpid()) >= (int)sizeof(tmp.sun_path)) {
+		fprintf(stderr, "Error!\t %s: path too long\n", root);
+		return 1;
+	}
+	unlink(tmp.sun_path);
+
+	if (bind(fd, (struct sockaddr *)&tmp, sizeof(tmp)) == -1) {
+		fprintf(stderr, "Error!\t bind %s: %s\n", tmp.sun_path,
+			strerror(errno));
+		return 1;
+	}
+	/* publishers of any user send to it */
+	chmod(tmp.sun_path, 0666);
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	if (rename(tmp.sun_path, sa.sun_path) == -1) {
+		fprintf(stderr, "Error!\t rename %s: %s\n", sa.sun_path,
+			strerror(errno));
+		unlink(tmp.sun_path);
+		return 1;
+	}
+
+	/* without SA_RESTART, recvmmsg() returns to look at the flags */
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = __on_signal;
+	sigaction(SIGTERM, &act, NULL);
+	sigaction(SIGINT, &act, NULL);
+	sigaction(SIGUSR1, &act, NULL);
+
+	clients = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					__client_free);
+	subs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+				     (GDestroyNotify)g_ptr_array_unref);
+	all = g_ptr_array_new();
+
+	__serve(fd);
+
+	unlink(sa.sun_path);
+	__dump();
+	g_hash_table_destroy(clients);
+	g_hash_table_destroy(subs);
+	g_ptr_array_free(all, TRUE);
+	close(fd);
+
+	return 0;
+}
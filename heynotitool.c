@@ -40,8 +40,6 @@
 const int SHARED_PERM = 0666;
 const int USER_PERM = 0644;
 
-const char *HEYNOTI_PREFIX = "/opt/share/noti";
-
 static int is_app = FALSE;
 static int perm = 0;
 static int user_id = 5000;
@@ -74,18 +72,28 @@ static void __print_help(const char *cmd)
 //	fprintf(stderr, "\n");
 //	fprintf(stderr, "       Ex) %s unset heynoti_test\n", cmd);
 //	fprintf(stderr, "\n");
+	fprintf(stderr, "[Move heynoti keys to hashed subdirectories]\n");
+	fprintf(stderr, "       %s migrate\n", cmd);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "[Remove heynoti keys of exited processes]\n");
+	fprintf(stderr, "       %s gc\n", cmd);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "[Make the key registry again from the key files]\n");
+	fprintf(stderr, "       %s registry\n", cmd);
+	fprintf(stderr, "\n");
 }
 
 static int __make_file_path(char *pszKey, char *pszBuf)
 {
-	snprintf(pszBuf, BUFSIZE, "%s/%s", HEYNOTI_PREFIX, pszKey);
-	return 0;
+	/* flat or sharded, as the library sees the noti root */
+	return heynoti_get_noti_path(pszKey, pszBuf, BUFSIZE);
 }
 
 int main(int argc, char **argv)
 {
 	char szFilePath[BUFSIZE] = { 0, };
 	int fd;
+	int n;
 
 	GError *error = NULL;
 	GOptionContext *context;
@@ -145,6 +153,32 @@ int main(int argc, char **argv)
 		}
 		/*  End File creation **********************************/
 
+		if (heynoti_register_key(argv[2], perm))
+			fprintf(stderr, "Warning!\t fail to register key\n");
+
+	} else if (!strncmp(argv[1], "migrate", 7)) {
+		if (0 != getuid()) {
+			fprintf(stderr,
+				"Error!\t Only root user can migrate keys\n");
+			return -1;
+		}
+
+		n = heynoti_migrate_sharded();
+		if (n < 0) {
+			fprintf(stderr, "Error!\t fail to migrate keys\n");
+			return -1;
+		}
+		printf("%d keys moved\n", n);
+	} else if (!strncmp(argv[1], "gc", 2)) {
+		n = heynoti_gc_pnoti();
+		printf("%d keys removed\n", n);
+	} else if (!strncmp(argv[1], "registry", 8)) {
+		n = heynoti_rebuild_registry();
+		if (n < 0) {
+			fprintf(stderr, "Error!\t fail to rebuild registry\n");
+			return -1;
+		}
+		printf("%d keys registered\n", n);
 	} else if (!strncmp(argv[1], "unset", 5)) {
 		if (argv[2]) {
 			if (__make_file_path(argv[2], szFilePath)) {
@@ -156,6 +190,7 @@ int main(int argc, char **argv)
 				fprintf(stderr, "Error!\t fail to remove file\n");
 				return -1;
 			}
+			heynoti_unregister_key(argv[2]);
 		}
 		else
 			__print_help(argv[0]);
@@ -0,0 +1,57 @@
+/*
+ * heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __HEYNOTI_BROKER_H__
+#define __HEYNOTI_BROKER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Datagrams between libheynoti and heynotid, over a Unix socket in
+ * noti_root. A context subscribes the keys of its socket, the broker
+ * forwards each publish datagram as is to the sockets subscribing its
+ * key. A key is the hash of the name the library routes by. The broker
+ * renames its socket in place when it starts, so contexts that knew an
+ * earlier one subscribe again.
+ */
+#define BROKER_SOCK	".heynoti_broker"
+#define BROKER_NAME_MAX	255
+
+enum {
+	BROKER_SUB = 1,		/* key */
+	BROKER_UNSUB,		/* key */
+	BROKER_SUB_ALL,		/* every key, for patterns */
+	BROKER_UNSUB_ALL,
+	BROKER_BYE,		/* the context is closed */
+	BROKER_PUB,		/* key and name */
+};
+
+struct broker_msg {
+	uint32_t op;
+	int32_t key;
+	char name[BROKER_NAME_MAX + 1];	/* of BROKER_PUB, NUL terminated */
+};
+
+#define BROKER_MSG_MIN	offsetof(struct broker_msg, name)
+
+#endif /* __HEYNOTI_BROKER_H__ */
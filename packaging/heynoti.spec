@@ -59,6 +59,7 @@ chmod 1755 /opt/share/noti
 %{_libdir}/libheynoti.so.0
 %{_libdir}/libheynoti.so.0.0.2
 %{_bindir}/heynotitool
+%{_bindir}/heynotid
 
 
 %files devel
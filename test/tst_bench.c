@@ -0,0 +1,259 @@
+/*
+ * heynoti
+ *
+ * Copyright (c) 2000 - 2011 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact: Jayoun Lee <airjany@samsung.com>, Sewook Park <sewook7.park@samsung.com>,
+ * Jaeho Lee <jaeho81.lee@samsung.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+/*
+ * System calls and time a notification costs, by backend: one process
+ * publishes a key and dispatches it, N times. The system calls are
+ * counted by tracing a second run of the same loop, heynotid's own
+ * are not.
+ *
+ * usage) tst_bench [N] [BACKEND...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "heynoti.h"
+
+#define NOTINAME "heynoti_bench"
+#define N_DEFAULT 10000
+
+static const struct {
+	long nr;
+	const char *name;
+} sys_names[] = {
+#ifdef SYS_open
+	{ SYS_open, "open" },
+#endif
+	{ SYS_openat, "openat" },
+	{ SYS_close, "close" },
+	{ SYS_read, "read" },
+	{ SYS_write, "write" },
+	{ SYS_ioctl, "ioctl" },
+#ifdef SYS_poll
+	{ SYS_poll, "poll" },
+#endif
+	{ SYS_ppoll, "ppoll" },
+	{ SYS_futex, "futex" },
+	{ SYS_sendto, "sendto" },
+	{ SYS_recvfrom, "recvfrom" },
+#ifdef SYS_io_uring_enter
+	{ SYS_io_uring_enter, "io_uring_enter" },
+#endif
+};
+
+#define N_NAMES (sizeof(sys_names) / sizeof(sys_names[0]))
+
+static int got;
+
+static void callback(void *data)
+{
+	got++;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* the loop measured, between two getppid() calls marking it */
+static int run(const char *backend, int n, double *us)
+{
+	struct pollfd p;
+	double t;
+	int fd;
+	int i;
+
+	if (heynoti_set_backend(backend) == -1)
+		return -1;
+
+	fd = heynoti_init();
+	if (fd == -1 || heynoti_subscribe(fd, NOTINAME, callback, NULL) == -1)
+		return -1;
+
+	p.fd = fd;
+	p.events = POLLIN;
+
+	getppid();
+	t = now();
+	for (i = 0; i < n; i++) {
+		heynoti_publish(NOTINAME);
+		while (got <= i && poll(&p, 1, 1000) == 1)
+			heynoti_poll_event(fd);
+	}
+	*us = (now() - t) / n;
+	getppid();
+
+	heynoti_close(fd);
+
+	return got;
+}
+
+/* counts the system calls of the loop of a traced child, by name */
+static long trace(pid_t pid, long *counts)
+{
+	long total = 0;
+	int marks = 0;
+	int status;
+	int sig;
+	unsigned int i;
+	pid_t t;
+#ifdef PTRACE_GET_SYSCALL_INFO
+	struct __ptrace_syscall_info info;
+#endif
+
+	waitpid(pid, &status, 0);
+	ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD |
+	       PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+	ptrace(PTRACE_SYSCALL, pid, 0, 0);
+
+	while ((t = waitpid(-1, &status, __WALL)) > 0) {
+		if (WIFEXITED(status) || WIFSIGNALED(status)) {
+			if (t == pid)
+				break;
+			continue;
+		}
+
+		sig = 0;
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+#ifdef PTRACE_GET_SYSCALL_INFO
+			if (ptrace(PTRACE_GET_SYSCALL_INFO, t, sizeof(info),
+				   &info) > 0 &&
+			    info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+				if (info.entry.nr == SYS_getppid) {
+					marks++;
+				} else if (marks == 1) {
+					total++;
+					for (i = 0; i < N_NAMES; i++)
+						if (sys_names[i].nr ==
+						    (long)info.entry.nr)
+							counts[i]++;
+				}
+			}
+#endif
+		} else if (WSTOPSIG(status) != SIGTRAP &&
+			   WSTOPSIG(status) != SIGSTOP) {
+			sig = WSTOPSIG(status);
+		}
+		ptrace(PTRACE_SYSCALL, t, 0, sig);
+	}
+
+	return total;
+}
+
+static void bench(const char *backend, int n)
+{
+	long counts[N_NAMES];
+	long total;
+	long named;
+	double us;
+	unsigned int i;
+	int status;
+	pid_t pid;
+
+	/* timed untraced, then counted traced */
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+		_exit(run(backend, n, &us) == n ? (printf("%-8s %8.2f us",
+				backend, us), fflush(stdout), 0) : 1);
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printf("%-8s unavailable\n", backend);
+		return;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		ptrace(PTRACE_TRACEME, 0, 0, 0);
+		raise(SIGSTOP);
+		_exit(run(backend, n, &us) == n ? 0 : 1);
+	}
+
+	memset(counts, 0, sizeof(counts));
+	total = trace(pid, counts);
+
+	printf(" %8.2f syscalls:", (double)total / n);
+	named = 0;
+	for (i = 0; i < N_NAMES; i++) {
+		named += counts[i];
+		if (counts[i] >= n / 100)
+			printf(" %s %.2f", sys_names[i].name,
+			       (double)counts[i] / n);
+	}
+	if (total - named >= n / 100)
+		printf(" other %.2f", (double)(total - named) / n);
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *all[] = { "inotify", "uring", "shm", "broker" };
+	char path[FILENAME_MAX];
+	FILE *fp;
+	int n = N_DEFAULT;
+	int i;
+
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if (n <= 0) {
+		printf("usage) %s [N] [BACKEND...]\n", argv[0]);
+		return -1;
+	}
+
+	/* the key file, and its registry entry for shm and broker lookups */
+	if (heynoti_get_noti_path(NOTINAME, path, sizeof(path)) != 0) {
+		printf("%s: no key path\n", NOTINAME);
+		return -1;
+	}
+	fp = fopen(path, "a");
+	if (fp == NULL) {
+		printf("%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	fclose(fp);
+	heynoti_register_key(NOTINAME, 0644);
+
+	printf("%d notifications, per notification:\n", n);
+	if (argc > 2) {
+		for (i = 2; i < argc; i++)
+			bench(argv[i], n);
+	} else {
+		for (i = 0; i < (int)(sizeof(all) / sizeof(all[0])); i++)
+			bench(all[i], n);
+	}
+
+	return 0;
+}